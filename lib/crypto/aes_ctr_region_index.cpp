@@ -0,0 +1,81 @@
+#include <algorithm>
+#include "aes_ctr_region_index.h"
+
+AesCtrRegionIndex::AesCtrRegionIndex()
+{
+}
+
+AesCtrRegionIndex::~AesCtrRegionIndex()
+{
+}
+
+void AesCtrRegionIndex::AddRegion(size_t start, size_t end, const uint8_t aes_key[Crypto::kAes128KeySize], const uint8_t aes_ctr[Crypto::kAesBlockSize])
+{
+	if (start >= end)
+	{
+		throw ProjectSnakeException(kModuleName, "Illegal start/end position");
+	}
+	if (aes_key == nullptr || aes_ctr == nullptr)
+	{
+		throw ProjectSnakeException(kModuleName, "Illegal aes configuration (nullptr)");
+	}
+
+	// keep the regions sorted, a new region may only fill a gap between existing ones
+	auto itr = std::lower_bound(regions_.begin(), regions_.end(), start, [](const CryptRegion& region, size_t start) { return region.start() < start; });
+	if ((itr != regions_.end() && itr->start() < end) || (itr != regions_.begin() && (itr - 1)->end() > start))
+	{
+		throw ProjectSnakeException(kModuleName, "Region overlaps an existing region");
+	}
+
+	regions_.insert(itr, CryptRegion(start, end, aes_key, aes_ctr));
+}
+
+void AesCtrRegionIndex::crypt(size_t offset, size_t size, uint8_t* data) const
+{
+	size_t cursor = 0;
+	crypt(offset, size, data, cursor);
+}
+
+void AesCtrRegionIndex::crypt(size_t offset, size_t size, uint8_t* data, size_t& cursor) const
+{
+	size_t crypt_size = 0;
+	for (size_t pos = 0; pos < size; pos += crypt_size)
+	{
+		size_t idx = FindRegion(offset + pos, cursor);
+
+		// there are no more crypto regions
+		if (idx == regions_.size())
+		{
+			break;
+		}
+
+		// skip the gap before the next crypto region
+		const CryptRegion& region = regions_[idx];
+		if (region.is_in_region(offset + pos) == false)
+		{
+			crypt_size = std::min(region.start() - (offset + pos), size - pos);
+			continue;
+		}
+
+		crypt_size = std::min(region.remaining_size(offset + pos), size - pos);
+		region.Crypt(offset + pos, crypt_size, data + pos);
+	}
+}
+
+size_t AesCtrRegionIndex::FindRegion(size_t pos, size_t& cursor) const
+{
+	// returns the index of the region containing pos, or of the first region after it (regions_.size() if there are none)
+	// as regions don't overlap, they are sorted by end as well as by start
+	for (size_t idx = cursor; idx < regions_.size() && idx <= cursor + 1; idx++)
+	{
+		if (regions_[idx].end() > pos && (idx == 0 || regions_[idx - 1].end() <= pos))
+		{
+			cursor = idx;
+			return idx;
+		}
+	}
+
+	auto itr = std::upper_bound(regions_.begin(), regions_.end(), pos, [](size_t pos, const CryptRegion& region) { return pos < region.end(); });
+	cursor = itr - regions_.begin();
+	return cursor;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fnd/project_snake_exception.h>
+#include <crypto/crypto.h>
+#include <crypto/aes_key_schedule.h>
+
+/*
+ AES-CTR regions of a stream, sorted by start and never overlapping.
+ Data outside every region is plaintext. Crypting doesn't change the
+ index, so once the regions are added it may be used from multiple threads.
+*/
+class AesCtrRegionIndex
+{
+public:
+	AesCtrRegionIndex();
+	~AesCtrRegionIndex();
+
+	void AddRegion(size_t start, size_t end, const uint8_t aes_key[Crypto::kAes128KeySize], const uint8_t aes_ctr[Crypto::kAesBlockSize]);
+
+	// crypts data from [offset, offset + size) of the stream in place
+	void crypt(size_t offset, size_t size, uint8_t* data) const;
+	// same, cursor holds the index of the region last used by the caller, so sequential access rarely needs a search
+	void crypt(size_t offset, size_t size, uint8_t* data, size_t& cursor) const;
+
+private:
+	const std::string kModuleName = "AES_CTR_REGION_INDEX";
+
+	// private implementation of crypto region
+	class CryptRegion
+	{
+	public:
+		// encrypted constructor
+		CryptRegion(size_t start, size_t end, const uint8_t aes_key[Crypto::kAes128KeySize], const uint8_t aes_ctr[Crypto::kAesBlockSize]) :
+			start_(start),
+			end_(end)
+		{
+			key_.SetKey(aes_key, AesKeySchedule::USAGE_ENCRYPT); // ctr mode only runs the cipher forwards
+			memcpy(ctr_init_, aes_ctr, Crypto::kAesBlockSize);
+		}
+
+		size_t start() const { return start_; }
+		size_t end() const { return end_; }
+		size_t remaining_size(size_t start) const { return end_ - start; }
+
+		bool is_in_region(size_t start) const { return start >= start_ && start < end_; }
+		bool is_in_region(size_t start, size_t end) const { return is_in_region(start) && end > start_ && end <= end_; }
+
+		// crypts [start, start + size) of data in place
+		void Crypt(size_t start, size_t size, uint8_t* data) const
+		{
+			// don't operate if requested size exceeds region size
+			if (is_in_region(start, start + size) == false)
+			{
+				return;
+			}
+
+			Crypto::AesCtr(key_, ctr_init_, start - start_, data, size, data);
+		}
+	private:
+		size_t start_;
+		size_t end_;
+		AesKeySchedule key_;
+		uint8_t ctr_init_[Crypto::kAesBlockSize];
+	};
+
+	std::vector<CryptRegion> regions_;
+
+	size_t FindRegion(size_t pos, size_t& cursor) const;
+};
@@ -1,8 +1,8 @@
 #include "aes_ctr_stream.h"
 
-
-
-AesCtrStream::AesCtrStream()
+AesCtrStream::AesCtrStream() :
+	offset_(0),
+	region_cursor_(0)
 {
 }
 
@@ -26,16 +26,15 @@ void AesCtrStream::read(size_t size, uint8_t * out)
 		// calculate read size
 		read_size = (size - pos) < kIoBufferLen ? (size - pos) : kIoBufferLen;		
 		
-		// read data
-		read_internal(read_size, read_len, io_buffer_);
+		// read data straight into the output
+		read_internal(read_size, read_len, out + pos);
 		if (read_size != read_len)
 		{
 			throw ProjectSnakeException(kModuleName, "Stream read length unexpected");
 		}
 
-		// crypt data
-		GenerateXorPad(offset_);
-		xor_data(read_size, pad_buffer_, io_buffer_, out + pos);
+		// crypt data in place
+		CryptData(offset_, read_size, out + pos);
 	}
 }
 
@@ -55,8 +54,8 @@ void AesCtrStream::write(size_t size, const uint8_t * in)
 		write_size = (size - pos) < kIoBufferLen ? (size - pos) : kIoBufferLen;
 
 		// crypt data
-		GenerateXorPad(offset_);
-		xor_data(write_size, pad_buffer_, in + pos, io_buffer_);
+		memcpy(io_buffer_, in + pos, write_size);
+		CryptData(offset_, write_size, io_buffer_);
 		
 		// write data
 		write_internal(write_size, write_len, io_buffer_);
@@ -75,64 +74,17 @@ void AesCtrStream::write(size_t offset, size_t size, const uint8_t * in)
 
 void AesCtrStream::AddRegion(size_t start, size_t end, const uint8_t aes_key[Crypto::kAes128KeySize], const uint8_t aes_ctr[Crypto::kAesBlockSize])
 {
-	if (start >= end)
-	{
-		throw ProjectSnakeException(kModuleName, "Illegal start/end position");
-	}
-	if (aes_key == nullptr || aes_ctr == nullptr)
-	{
-		throw ProjectSnakeException(kModuleName, "Illegal aes configuration (nullptr)");
-	}
-
-	regions_.push_back(CryptRegion(start, end, aes_key, aes_ctr));
+	regions_.AddRegion(start, end, aes_key, aes_ctr);
+	region_cursor_ = 0;
 }
 
-void AesCtrStream::GenerateXorPad(size_t start)
+void AesCtrStream::crypt(size_t offset, size_t size, uint8_t* data) const
 {
-	size_t pad_size = 0;
-	for (size_t pos = 0; pos < kIoBufferLen; pos += pad_size)
-	{
-		CryptRegion* cur_region = nullptr;
-		CryptRegion* next_region = nullptr;
-		for (size_t idx = 0; idx < regions_.size(); idx++)
-		{
-			if (regions_[idx].is_in_region(start + pos))
-			{
-				cur_region = &regions_[idx];
-			}
-			else if (regions_[idx].start() > (start + pos) && (next_region == nullptr || next_region->start() > regions_[idx].start()))
-			{
-				next_region = &regions_[idx];
-			}
-		}
-		
-		// if this exists in the a crypto region
-		if (cur_region != nullptr)
-		{
-			pad_size = cur_region->remaining_size(start + pos);
-			if (pad_size > kIoBufferLen - pos)
-			{
-				pad_size = kIoBufferLen - pos;
-			}
-			cur_region->GenerateXorpad(start + pos, pad_size, pad_buffer_ + pos);
-		}
-
-		// there is a crypto region ahead, bridge the gap
-		else if (next_region != nullptr)
-		{
-			pad_size = next_region->start() - (start + pos);
-			if (pad_size > kIoBufferLen - pos)
-			{
-				pad_size = kIoBufferLen - pos;
-			}
-			memset(pad_buffer_ + pos, 0, pad_size);
-		}
-		// there are no more crypto regions
-		else
-		{
-			pad_size = kIoBufferLen - pos;
-			memset(pad_buffer_ + pos, 0, pad_size);
-		}
-	}
+	// a fresh search each time instead of the shared cursor
+	regions_.crypt(offset, size, data);
+}
 
+void AesCtrStream::CryptData(size_t start, size_t size, uint8_t* data)
+{
+	regions_.crypt(start, size, data, region_cursor_);
 }
@@ -0,0 +1,95 @@
+#include "aes_key_schedule.h"
+
+AesKeySchedule::AesKeySchedule() :
+	use_aes_ni_(AesNi::IsSupported())
+{
+	// nothing is expanded until a key is set
+	Clear();
+}
+
+AesKeySchedule::AesKeySchedule(const uint8_t key[Crypto::kAes128KeySize]) :
+	use_aes_ni_(AesNi::IsSupported())
+{
+	SetKey(key);
+}
+
+AesKeySchedule::AesKeySchedule(const uint8_t key[Crypto::kAes128KeySize], KeyUsage usage) :
+	use_aes_ni_(AesNi::IsSupported())
+{
+	SetKey(key, usage);
+}
+
+AesKeySchedule::AesKeySchedule(const AesKeySchedule& other)
+{
+	*this = other;
+}
+
+AesKeySchedule::~AesKeySchedule()
+{
+	memset(enc_round_keys_, 0, sizeof(enc_round_keys_));
+	memset(dec_round_keys_, 0, sizeof(dec_round_keys_));
+	memset(&enc_ctx_, 0, sizeof(enc_ctx_));
+	memset(&dec_ctx_, 0, sizeof(dec_ctx_));
+}
+
+AesKeySchedule& AesKeySchedule::operator=(const AesKeySchedule& other)
+{
+	use_aes_ni_ = other.use_aes_ni_;
+	memcpy(enc_round_keys_, other.enc_round_keys_, sizeof(enc_round_keys_));
+	memcpy(dec_round_keys_, other.dec_round_keys_, sizeof(dec_round_keys_));
+	CopyContext(other.enc_ctx_, enc_ctx_);
+	CopyContext(other.dec_ctx_, dec_ctx_);
+
+	return *this;
+}
+
+void AesKeySchedule::SetKey(const uint8_t key[Crypto::kAes128KeySize])
+{
+	SetKey(key, USAGE_ENCRYPT_DECRYPT);
+}
+
+void AesKeySchedule::SetKey(const uint8_t key[Crypto::kAes128KeySize], KeyUsage usage)
+{
+	Clear();
+
+	// one-shot callers only expand the schedule they use, the polarssl decryption schedule costs a second expansion
+	if (use_aes_ni_)
+	{
+		if (usage & USAGE_ENCRYPT)
+		{
+			AesNi::ExpandEncryptKey(key, enc_round_keys_);
+		}
+		if (usage & USAGE_DECRYPT)
+		{
+			AesNi::ExpandDecryptKey(key, dec_round_keys_);
+		}
+	}
+	else
+	{
+		if (usage & USAGE_ENCRYPT)
+		{
+			aes_setkey_enc(&enc_ctx_, key, 128);
+		}
+		if (usage & USAGE_DECRYPT)
+		{
+			aes_setkey_dec(&dec_ctx_, key, 128);
+		}
+	}
+}
+
+void AesKeySchedule::Clear()
+{
+	memset(enc_round_keys_, 0, sizeof(enc_round_keys_));
+	memset(dec_round_keys_, 0, sizeof(dec_round_keys_));
+	memset(&enc_ctx_, 0, sizeof(enc_ctx_));
+	memset(&dec_ctx_, 0, sizeof(dec_ctx_));
+	enc_ctx_.rk = enc_ctx_.buf;
+	dec_ctx_.rk = dec_ctx_.buf;
+}
+
+void AesKeySchedule::CopyContext(const aes_context& src, aes_context& dst)
+{
+	// the polarssl context points into its own buffer, so the pointer is rebased rather than copied
+	memcpy(&dst, &src, sizeof(aes_context));
+	dst.rk = dst.buf + (src.rk - src.buf);
+}
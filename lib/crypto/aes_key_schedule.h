@@ -0,0 +1,45 @@
+#pragma once
+#include "crypto.h"
+#include "aes_ni.h"
+#include "polarssl/aes.h"
+
+/*
+ AES-128 key expanded once for repeated use with Crypto's AES modes.
+ The encryption and/or decryption schedule is built, in the form the
+ active backend needs (AES-NI round keys or PolarSSL contexts). CTR mode
+ and CBC encryption only use the encryption schedule.
+ Safe to share between threads once set.
+*/
+class AesKeySchedule
+{
+public:
+	enum KeyUsage
+	{
+		USAGE_ENCRYPT = 1 << 0,
+		USAGE_DECRYPT = 1 << 1,
+		USAGE_ENCRYPT_DECRYPT = USAGE_ENCRYPT | USAGE_DECRYPT
+	};
+
+	AesKeySchedule(); // holds no key, SetKey must be called before use
+	explicit AesKeySchedule(const uint8_t key[Crypto::kAes128KeySize]);
+	AesKeySchedule(const uint8_t key[Crypto::kAes128KeySize], KeyUsage usage); // the schedule left out must not be used
+	AesKeySchedule(const AesKeySchedule& other);
+	~AesKeySchedule();
+
+	AesKeySchedule& operator=(const AesKeySchedule& other);
+
+	void SetKey(const uint8_t key[Crypto::kAes128KeySize]);
+	void SetKey(const uint8_t key[Crypto::kAes128KeySize], KeyUsage usage);
+
+private:
+	friend class Crypto;
+
+	bool use_aes_ni_;
+	uint8_t enc_round_keys_[AesNi::kRoundKeySize];
+	uint8_t dec_round_keys_[AesNi::kRoundKeySize];
+	aes_context enc_ctx_;
+	aes_context dec_ctx_;
+
+	void Clear();
+	static void CopyContext(const aes_context& src, aes_context& dst);
+};
@@ -0,0 +1,290 @@
+#include "aes_ni.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define AESNI_ARCH_X86
+#endif
+
+#ifdef AESNI_ARCH_X86
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AESNI_TARGET
+#define AESNI_BSWAP64(x) _byteswap_uint64(x)
+#else
+// only these functions are built for AES-NI, the rest of the library stays generic
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+#define AESNI_BSWAP64(x) __builtin_bswap64(x)
+#endif
+#endif
+
+#ifdef AESNI_ARCH_X86
+static const int kRoundNum = 10;
+static const size_t kParallelBlockNum = 8; // enough blocks in flight to cover aesenc latency
+
+AESNI_TARGET static inline __m128i ExpandKeyStep(__m128i key, __m128i keygen)
+{
+	keygen = _mm_shuffle_epi32(keygen, _MM_SHUFFLE(3, 3, 3, 3));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, keygen);
+}
+
+AESNI_TARGET static void ExpandKey(const uint8_t key[AesNi::kBlockSize], __m128i rk[kRoundNum + 1])
+{
+	// _mm_aeskeygenassist_si128 needs the round constant as an immediate
+	rk[0] = _mm_loadu_si128((const __m128i*)key);
+	rk[1] = ExpandKeyStep(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+	rk[2] = ExpandKeyStep(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+	rk[3] = ExpandKeyStep(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+	rk[4] = ExpandKeyStep(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+	rk[5] = ExpandKeyStep(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+	rk[6] = ExpandKeyStep(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+	rk[7] = ExpandKeyStep(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+	rk[8] = ExpandKeyStep(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+	rk[9] = ExpandKeyStep(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1B));
+	rk[10] = ExpandKeyStep(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+}
+
+AESNI_TARGET static inline void LoadRoundKeys(const uint8_t round_keys[AesNi::kRoundKeySize], __m128i rk[kRoundNum + 1])
+{
+	for (int i = 0; i <= kRoundNum; i++)
+	{
+		rk[i] = _mm_loadu_si128((const __m128i*)(round_keys + i * AesNi::kBlockSize));
+	}
+}
+
+AESNI_TARGET static inline __m128i EncryptBlock(__m128i block, const __m128i rk[kRoundNum + 1])
+{
+	block = _mm_xor_si128(block, rk[0]);
+	for (int i = 1; i < kRoundNum; i++)
+	{
+		block = _mm_aesenc_si128(block, rk[i]);
+	}
+	return _mm_aesenclast_si128(block, rk[kRoundNum]);
+}
+
+AESNI_TARGET static inline __m128i DecryptBlock(__m128i block, const __m128i rk[kRoundNum + 1])
+{
+	block = _mm_xor_si128(block, rk[0]);
+	for (int i = 1; i < kRoundNum; i++)
+	{
+		block = _mm_aesdec_si128(block, rk[i]);
+	}
+	return _mm_aesdeclast_si128(block, rk[kRoundNum]);
+}
+
+// the counter is a 128bit big endian integer, kept as two native halves
+static inline void LoadCounter(const uint8_t ctr[AesNi::kBlockSize], uint64_t& hi, uint64_t& lo)
+{
+	uint64_t be_hi, be_lo;
+	memcpy(&be_hi, ctr, sizeof(uint64_t));
+	memcpy(&be_lo, ctr + sizeof(uint64_t), sizeof(uint64_t));
+	hi = AESNI_BSWAP64(be_hi);
+	lo = AESNI_BSWAP64(be_lo);
+}
+
+static inline void StoreCounter(uint64_t hi, uint64_t lo, uint8_t ctr[AesNi::kBlockSize])
+{
+	uint64_t be_hi = AESNI_BSWAP64(hi);
+	uint64_t be_lo = AESNI_BSWAP64(lo);
+	memcpy(ctr, &be_hi, sizeof(uint64_t));
+	memcpy(ctr + sizeof(uint64_t), &be_lo, sizeof(uint64_t));
+}
+
+AESNI_TARGET static inline __m128i NextCounterBlock(uint64_t& hi, uint64_t& lo)
+{
+	__m128i block = _mm_set_epi64x((long long)AESNI_BSWAP64(lo), (long long)AESNI_BSWAP64(hi));
+	lo++;
+	if (lo == 0)
+	{
+		hi++;
+	}
+	return block;
+}
+#endif
+
+bool AesNi::IsSupported()
+{
+#ifdef AESNI_ARCH_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	static const bool is_supported = (info[2] & (1 << 25)) != 0;
+#else
+	static const bool is_supported = __builtin_cpu_supports("aes") != 0;
+#endif
+	return is_supported;
+#else
+	return false;
+#endif
+}
+
+#ifdef AESNI_ARCH_X86
+AESNI_TARGET void AesNi::ExpandEncryptKey(const uint8_t key[kBlockSize], uint8_t round_keys[kRoundKeySize])
+{
+	__m128i rk[kRoundNum + 1];
+	ExpandKey(key, rk);
+	for (int i = 0; i <= kRoundNum; i++)
+	{
+		_mm_storeu_si128((__m128i*)(round_keys + i * kBlockSize), rk[i]);
+	}
+}
+
+AESNI_TARGET void AesNi::ExpandDecryptKey(const uint8_t key[kBlockSize], uint8_t round_keys[kRoundKeySize])
+{
+	// equivalent inverse cipher: reversed order, inner round keys through InvMixColumns
+	__m128i rk[kRoundNum + 1];
+	ExpandKey(key, rk);
+	_mm_storeu_si128((__m128i*)round_keys, rk[kRoundNum]);
+	for (int i = 1; i < kRoundNum; i++)
+	{
+		_mm_storeu_si128((__m128i*)(round_keys + i * kBlockSize), _mm_aesimc_si128(rk[kRoundNum - i]));
+	}
+	_mm_storeu_si128((__m128i*)(round_keys + kRoundNum * kBlockSize), rk[0]);
+}
+
+AESNI_TARGET void AesNi::CtrCrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t ctr[kBlockSize], uint8_t* out)
+{
+	__m128i rk[kRoundNum + 1];
+	LoadRoundKeys(round_keys, rk);
+
+	uint64_t hi, lo;
+	LoadCounter(ctr, hi, lo);
+
+	// interleave independent blocks so the aesenc pipeline stays full
+	while (size >= kParallelBlockNum * kBlockSize)
+	{
+		__m128i block[kParallelBlockNum];
+		for (size_t i = 0; i < kParallelBlockNum; i++)
+		{
+			block[i] = _mm_xor_si128(NextCounterBlock(hi, lo), rk[0]);
+		}
+		for (int r = 1; r < kRoundNum; r++)
+		{
+			for (size_t i = 0; i < kParallelBlockNum; i++)
+			{
+				block[i] = _mm_aesenc_si128(block[i], rk[r]);
+			}
+		}
+		for (size_t i = 0; i < kParallelBlockNum; i++)
+		{
+			block[i] = _mm_aesenclast_si128(block[i], rk[kRoundNum]);
+			block[i] = _mm_xor_si128(block[i], _mm_loadu_si128((const __m128i*)(in + i * kBlockSize)));
+			_mm_storeu_si128((__m128i*)(out + i * kBlockSize), block[i]);
+		}
+
+		in += kParallelBlockNum * kBlockSize;
+		out += kParallelBlockNum * kBlockSize;
+		size -= kParallelBlockNum * kBlockSize;
+	}
+
+	while (size >= kBlockSize)
+	{
+		__m128i block = EncryptBlock(NextCounterBlock(hi, lo), rk);
+		block = _mm_xor_si128(block, _mm_loadu_si128((const __m128i*)in));
+		_mm_storeu_si128((__m128i*)out, block);
+
+		in += kBlockSize;
+		out += kBlockSize;
+		size -= kBlockSize;
+	}
+
+	// a trailing partial block still consumes a whole counter value
+	if (size > 0)
+	{
+		uint8_t pad[kBlockSize];
+		_mm_storeu_si128((__m128i*)pad, EncryptBlock(NextCounterBlock(hi, lo), rk));
+		for (size_t i = 0; i < size; i++)
+		{
+			out[i] = in[i] ^ pad[i];
+		}
+	}
+
+	StoreCounter(hi, lo, ctr);
+}
+
+AESNI_TARGET void AesNi::CbcEncrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t iv[kBlockSize], uint8_t* out)
+{
+	// like PolarSSL, partial blocks are rejected by doing nothing
+	if (size % kBlockSize)
+	{
+		return;
+	}
+
+	__m128i rk[kRoundNum + 1];
+	LoadRoundKeys(round_keys, rk);
+
+	// each block depends on the previous ciphertext, so this is serial
+	__m128i chain = _mm_loadu_si128((const __m128i*)iv);
+	for (uint64_t pos = 0; pos < size; pos += kBlockSize)
+	{
+		chain = EncryptBlock(_mm_xor_si128(chain, _mm_loadu_si128((const __m128i*)(in + pos))), rk);
+		_mm_storeu_si128((__m128i*)(out + pos), chain);
+	}
+	_mm_storeu_si128((__m128i*)iv, chain);
+}
+
+AESNI_TARGET void AesNi::CbcDecrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t iv[kBlockSize], uint8_t* out)
+{
+	if (size % kBlockSize)
+	{
+		return;
+	}
+
+	__m128i rk[kRoundNum + 1];
+	LoadRoundKeys(round_keys, rk);
+
+	// decryption only needs the previous ciphertext, so blocks are independent
+	// ciphertext is loaded before any output is stored, which keeps in == out safe
+	__m128i chain = _mm_loadu_si128((const __m128i*)iv);
+	while (size >= kParallelBlockNum * kBlockSize)
+	{
+		__m128i cipher[kParallelBlockNum];
+		__m128i block[kParallelBlockNum];
+		for (size_t i = 0; i < kParallelBlockNum; i++)
+		{
+			cipher[i] = _mm_loadu_si128((const __m128i*)(in + i * kBlockSize));
+			block[i] = _mm_xor_si128(cipher[i], rk[0]);
+		}
+		for (int r = 1; r < kRoundNum; r++)
+		{
+			for (size_t i = 0; i < kParallelBlockNum; i++)
+			{
+				block[i] = _mm_aesdec_si128(block[i], rk[r]);
+			}
+		}
+		for (size_t i = 0; i < kParallelBlockNum; i++)
+		{
+			block[i] = _mm_aesdeclast_si128(block[i], rk[kRoundNum]);
+			block[i] = _mm_xor_si128(block[i], i == 0 ? chain : cipher[i - 1]);
+			_mm_storeu_si128((__m128i*)(out + i * kBlockSize), block[i]);
+		}
+		chain = cipher[kParallelBlockNum - 1];
+
+		in += kParallelBlockNum * kBlockSize;
+		out += kParallelBlockNum * kBlockSize;
+		size -= kParallelBlockNum * kBlockSize;
+	}
+
+	while (size >= kBlockSize)
+	{
+		__m128i cipher = _mm_loadu_si128((const __m128i*)in);
+		_mm_storeu_si128((__m128i*)out, _mm_xor_si128(DecryptBlock(cipher, rk), chain));
+		chain = cipher;
+
+		in += kBlockSize;
+		out += kBlockSize;
+		size -= kBlockSize;
+	}
+	_mm_storeu_si128((__m128i*)iv, chain);
+}
+#else
+// never called, IsSupported() is false off x86
+void AesNi::ExpandEncryptKey(const uint8_t key[kBlockSize], uint8_t round_keys[kRoundKeySize]) {}
+void AesNi::ExpandDecryptKey(const uint8_t key[kBlockSize], uint8_t round_keys[kRoundKeySize]) {}
+void AesNi::CtrCrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t ctr[kBlockSize], uint8_t* out) {}
+void AesNi::CbcEncrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t iv[kBlockSize], uint8_t* out) {}
+void AesNi::CbcDecrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t iv[kBlockSize], uint8_t* out) {}
+#endif
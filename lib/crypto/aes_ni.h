@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+/*
+ AES-128 using the x86 AES instructions.
+ Callers must check IsSupported() first, the other methods are only
+ compiled for x86 targets and execute AES-NI instructions unconditionally.
+ Semantics match the PolarSSL modes used by Crypto (counter/iv are updated).
+*/
+class AesNi
+{
+public:
+	static const size_t kBlockSize = 0x10;
+	static const size_t kRoundKeySize = 11 * kBlockSize; // aes-128 key schedule
+
+	static bool IsSupported();
+
+	static void ExpandEncryptKey(const uint8_t key[kBlockSize], uint8_t round_keys[kRoundKeySize]);
+	static void ExpandDecryptKey(const uint8_t key[kBlockSize], uint8_t round_keys[kRoundKeySize]);
+
+	static void CtrCrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t ctr[kBlockSize], uint8_t* out);
+	static void CbcEncrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t iv[kBlockSize], uint8_t* out);
+	static void CbcDecrypt(const uint8_t round_keys[kRoundKeySize], const uint8_t* in, uint64_t size, uint8_t iv[kBlockSize], uint8_t* out);
+};
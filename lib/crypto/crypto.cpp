@@ -1,27 +1,261 @@
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "crypto.h"
+#include "aes_ni.h"
+#include "aes_key_schedule.h"
+#include "sha_ni.h"
+#include "sha256_multi_buffer.h"
+#include "rsa_key_context.h"
 #include "polarssl/aes.h"
 #include "polarssl/sha1.h"
 #include "polarssl/sha2.h"
 #include "polarssl/rsa.h"
 
+// one-shot hashes go through the incremental path, so they share the accelerated block functions
 void Crypto::Sha1(const uint8_t* in, uint64_t size, uint8_t hash[kSha1HashLen])
 {
-	sha1(in, size, hash);
+	sSha1Context ctx;
+	Sha1Init(ctx);
+	Sha1Update(ctx, in, size);
+	Sha1Final(ctx, hash);
 }
 
 void Crypto::Sha256(const uint8_t* in, uint64_t size, uint8_t hash[kSha256HashLen])
 {
-	sha2(in, size, hash, false);
+	sSha256Context ctx;
+	Sha256Init(ctx);
+	Sha256Update(ctx, in, size);
+	Sha256Final(ctx, hash);
+}
+
+// merkle-damgard buffering shared by sha1/sha256, both use 64 byte blocks and a big endian bit length
+template <class Context, void (*ProcessBlocks)(uint32_t*, const uint8_t*, size_t)>
+static void ShaUpdate(Context& ctx, const uint8_t* in, uint64_t size)
+{
+	size_t buffered = (size_t)(ctx.length % Crypto::kShaBlockSize);
+	ctx.length += size;
+
+	// top up a partially filled block first
+	if (buffered > 0)
+	{
+		size_t fill = Crypto::kShaBlockSize - buffered;
+		if (size < fill)
+		{
+			memcpy(ctx.buffer + buffered, in, (size_t)size);
+			return;
+		}
+
+		memcpy(ctx.buffer + buffered, in, fill);
+		ProcessBlocks(ctx.state, ctx.buffer, 1);
+		in += fill;
+		size -= fill;
+	}
+
+	// process whole blocks straight from the input
+	size_t block_num = (size_t)(size / Crypto::kShaBlockSize);
+	if (block_num > 0)
+	{
+		ProcessBlocks(ctx.state, in, block_num);
+		in += block_num * Crypto::kShaBlockSize;
+		size -= block_num * Crypto::kShaBlockSize;
+	}
+
+	// keep the tail for later
+	if (size > 0)
+	{
+		memcpy(ctx.buffer, in, (size_t)size);
+	}
+}
+
+template <class Context, void (*ProcessBlocks)(uint32_t*, const uint8_t*, size_t)>
+static void ShaFinal(Context& ctx, uint8_t* hash, size_t word_num)
+{
+	size_t buffered = (size_t)(ctx.length % Crypto::kShaBlockSize);
+	uint64_t bit_length = ctx.length << 3;
+
+	// append the 0x80 terminator, then pad so the length fills the last 8 bytes of a block
+	ctx.buffer[buffered++] = 0x80;
+	if (buffered > Crypto::kShaBlockSize - 8)
+	{
+		memset(ctx.buffer + buffered, 0, Crypto::kShaBlockSize - buffered);
+		ProcessBlocks(ctx.state, ctx.buffer, 1);
+		buffered = 0;
+	}
+	memset(ctx.buffer + buffered, 0, Crypto::kShaBlockSize - 8 - buffered);
+	for (size_t i = 0; i < 8; i++)
+	{
+		ctx.buffer[Crypto::kShaBlockSize - 1 - i] = (uint8_t)(bit_length >> (i * 8));
+	}
+	ProcessBlocks(ctx.state, ctx.buffer, 1);
+
+	for (size_t i = 0; i < word_num; i++)
+	{
+		hash[i * 4 + 0] = (uint8_t)(ctx.state[i] >> 24);
+		hash[i * 4 + 1] = (uint8_t)(ctx.state[i] >> 16);
+		hash[i * 4 + 2] = (uint8_t)(ctx.state[i] >> 8);
+		hash[i * 4 + 3] = (uint8_t)(ctx.state[i]);
+	}
+}
+
+void Crypto::Sha1Init(sSha1Context& ctx)
+{
+	static const uint32_t kInitialState[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	memcpy(ctx.state, kInitialState, sizeof(kInitialState));
+	ctx.length = 0;
+}
+
+void Crypto::Sha1Update(sSha1Context& ctx, const uint8_t* in, uint64_t size)
+{
+	ShaUpdate<sSha1Context, Sha1ProcessBlocks>(ctx, in, size);
+}
+
+void Crypto::Sha1Final(sSha1Context& ctx, uint8_t hash[kSha1HashLen])
+{
+	ShaFinal<sSha1Context, Sha1ProcessBlocks>(ctx, hash, kSha1HashLen / sizeof(uint32_t));
+}
+
+void Crypto::Sha256Init(sSha256Context& ctx)
+{
+	static const uint32_t kInitialState[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+	memcpy(ctx.state, kInitialState, sizeof(kInitialState));
+	ctx.length = 0;
+}
+
+void Crypto::Sha256Update(sSha256Context& ctx, const uint8_t* in, uint64_t size)
+{
+	ShaUpdate<sSha256Context, Sha256ProcessBlocks>(ctx, in, size);
+}
+
+void Crypto::Sha256Final(sSha256Context& ctx, uint8_t hash[kSha256HashLen])
+{
+	ShaFinal<sSha256Context, Sha256ProcessBlocks>(ctx, hash, kSha256HashLen / sizeof(uint32_t));
+}
+
+void Crypto::Sha256Batch(const uint8_t* in, size_t block_num, size_t block_size, uint8_t* hashes)
+{
+	// split into contiguous ranges, one per thread, but only when each range is worth a thread
+	uint64_t total_size = (uint64_t)block_num * block_size;
+	size_t thread_num = std::thread::hardware_concurrency();
+	if ((uint64_t)thread_num > total_size / kSha256BatchMinThreadSize)
+	{
+		thread_num = (size_t)(total_size / kSha256BatchMinThreadSize);
+	}
+	if (thread_num <= 1)
+	{
+		Sha256BatchSerial(in, block_num, block_size, hashes);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	size_t blocks_per_thread = (block_num + thread_num - 1) / thread_num;
+	for (size_t first = 0; first < block_num; first += blocks_per_thread)
+	{
+		size_t num = (block_num - first) < blocks_per_thread ? (block_num - first) : blocks_per_thread;
+		threads.push_back(std::thread(Sha256BatchSerial, in + first * block_size, num, block_size, hashes + first * kSha256HashLen));
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void Crypto::Sha256BatchSerial(const uint8_t* in, size_t block_num, size_t block_size, uint8_t* hashes)
+{
+	// the sha extensions beat 8 avx2 lanes per core, so lanes are only used without them
+	size_t pos = 0;
+	if (ShaNi::IsSupported() == false && Sha256MultiBuffer::IsSupported())
+	{
+		for (; pos + Sha256MultiBuffer::kLaneNum <= block_num; pos += Sha256MultiBuffer::kLaneNum)
+		{
+			Sha256MultiBuffer::HashLanes(in + pos * block_size, block_size, hashes + pos * kSha256HashLen);
+		}
+	}
+
+	for (; pos < block_num; pos++)
+	{
+		Sha256(in + pos * block_size, block_size, hashes + pos * kSha256HashLen);
+	}
+}
+
+void Crypto::Sha1ProcessBlocks(uint32_t state[5], const uint8_t* in, size_t block_num)
+{
+	if (ShaNi::IsSupported())
+	{
+		ShaNi::Sha1ProcessBlocks(state, in, block_num);
+		return;
+	}
+
+	sha1_context ctx;
+	memcpy(ctx.state, state, sizeof(ctx.state));
+	for (size_t i = 0; i < block_num; i++)
+	{
+		sha1_process(&ctx, in + (i * kShaBlockSize));
+	}
+	memcpy(state, ctx.state, sizeof(ctx.state));
+}
+
+void Crypto::Sha256ProcessBlocks(uint32_t state[8], const uint8_t* in, size_t block_num)
+{
+	if (ShaNi::IsSupported())
+	{
+		ShaNi::Sha256ProcessBlocks(state, in, block_num);
+		return;
+	}
+
+	sha2_context ctx;
+	memcpy(ctx.state, state, sizeof(ctx.state));
+	for (size_t i = 0; i < block_num; i++)
+	{
+		sha2_process(&ctx, in + (i * kShaBlockSize));
+	}
+	memcpy(state, ctx.state, sizeof(ctx.state));
 }
 
 void Crypto::AesCtr(const uint8_t* in, uint64_t size, const uint8_t key[kAes128KeySize], uint8_t ctr[kAesBlockSize], uint8_t* out)
 {
-	aes_context ctx;
+	AesCtr(in, size, AesKeySchedule(key, AesKeySchedule::USAGE_ENCRYPT), ctr, out);
+}
+
+void Crypto::AesCtr(const uint8_t* in, uint64_t size, const AesKeySchedule& key, uint8_t ctr[kAesBlockSize], uint8_t* out)
+{
+	if (key.use_aes_ni_)
+	{
+		AesNi::CtrCrypt(key.enc_round_keys_, in, size, ctr, out);
+		return;
+	}
+
+	// the context is only read, polarssl just doesn't declare it const
 	uint8_t block[kAesBlockSize] = { 0 };
 	size_t counterOffset = 0;
+	aes_crypt_ctr(const_cast<aes_context*>(&key.enc_ctx_), size, &counterOffset, ctr, block, in, out);
+}
 
-	aes_setkey_enc(&ctx, key, 128);
-	aes_crypt_ctr(&ctx, size, &counterOffset, ctr, block, in, out);
+void Crypto::AesCtr(const AesKeySchedule& key, const uint8_t ctr[kAesBlockSize], uint64_t offset, const uint8_t* in, uint64_t size, uint8_t* out)
+{
+	uint8_t block_ctr[kAesBlockSize];
+	AesIncrementCounter(ctr, offset >> 4, block_ctr);
+
+	// a start inside a block uses the tail of that block's keystream
+	size_t block_offset = offset & 0xf;
+	if (block_offset != 0 && size > 0)
+	{
+		uint8_t pad[kAesBlockSize] = { 0 };
+		AesCtr(pad, kAesBlockSize, key, block_ctr, pad);
+
+		size_t head_size = (kAesBlockSize - block_offset) < size ? (kAesBlockSize - block_offset) : size;
+		for (size_t i = 0; i < head_size; i++)
+		{
+			out[i] = in[i] ^ pad[block_offset + i];
+		}
+		in += head_size;
+		out += head_size;
+		size -= head_size;
+	}
+
+	AesCtr(in, size, key, block_ctr, out);
 }
 
 void Crypto::AesIncrementCounter(const uint8_t in[kAesBlockSize], size_t block_num, uint8_t out[kAesBlockSize])
@@ -56,33 +290,122 @@ void Crypto::AesIncrementCounter(const uint8_t in[kAesBlockSize], size_t block_n
 
 void Crypto::AesCbcDecrypt(const uint8_t* in, uint64_t size, const uint8_t key[kAes128KeySize], uint8_t iv[kAesBlockSize], uint8_t* out)
 {
-	aes_context ctx;
-	aes_setkey_dec(&ctx, key, 128);
-	aes_crypt_cbc(&ctx, AES_DECRYPT, size, iv, in, out);
+	AesCbcDecrypt(in, size, AesKeySchedule(key, AesKeySchedule::USAGE_DECRYPT), iv, out);
+}
+
+void Crypto::AesCbcDecrypt(const uint8_t* in, uint64_t size, const AesKeySchedule& key, uint8_t iv[kAesBlockSize], uint8_t* out)
+{
+	if (key.use_aes_ni_)
+	{
+		AesNi::CbcDecrypt(key.dec_round_keys_, in, size, iv, out);
+		return;
+	}
+
+	aes_crypt_cbc(const_cast<aes_context*>(&key.dec_ctx_), AES_DECRYPT, size, iv, in, out);
+}
+
+void Crypto::AesCbcDecryptParallel(const uint8_t* in, uint64_t size, const AesKeySchedule& key, uint8_t iv[kAesBlockSize], uint8_t* out)
+{
+	// each block only needs the ciphertext block before it, so contiguous chunks decrypt independently
+	uint64_t block_num = size / kAesBlockSize;
+	size_t thread_num = std::thread::hardware_concurrency();
+	if ((uint64_t)thread_num > size / kAesCbcDecryptMinThreadSize)
+	{
+		thread_num = (size_t)(size / kAesCbcDecryptMinThreadSize);
+	}
+	if (thread_num <= 1 || size % kAesBlockSize != 0)
+	{
+		AesCbcDecrypt(in, size, key, iv, out);
+		return;
+	}
+
+	// decrypting in place overwrites the ciphertext, so every chunk's iv and the final iv are saved before any thread starts
+	uint64_t blocks_per_thread = (block_num + thread_num - 1) / thread_num;
+	std::vector<uint8_t> chunk_ivs(thread_num * kAesBlockSize);
+	uint8_t last_block[kAesBlockSize];
+	memcpy(last_block, in + size - kAesBlockSize, kAesBlockSize);
+	for (uint64_t first = 0, i = 0; first < block_num; first += blocks_per_thread, i++)
+	{
+		memcpy(chunk_ivs.data() + i * kAesBlockSize, first == 0 ? iv : in + (first - 1) * kAesBlockSize, kAesBlockSize);
+	}
+
+	std::vector<std::thread> threads;
+	for (uint64_t first = 0, i = 0; first < block_num; first += blocks_per_thread, i++)
+	{
+		uint64_t num = (block_num - first) < blocks_per_thread ? (block_num - first) : blocks_per_thread;
+		uint8_t* chunk_iv = chunk_ivs.data() + i * kAesBlockSize;
+		const uint8_t* chunk_in = in + first * kAesBlockSize;
+		uint8_t* chunk_out = out + first * kAesBlockSize;
+		uint64_t chunk_size = num * kAesBlockSize;
+		threads.push_back(std::thread([&key, chunk_in, chunk_size, chunk_iv, chunk_out]() { AesCbcDecrypt(chunk_in, chunk_size, key, chunk_iv, chunk_out); }));
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	memcpy(iv, last_block, kAesBlockSize);
 }
 
 void Crypto::AesCbcEncrypt(const uint8_t* in, uint64_t size, const uint8_t key[kAes128KeySize], uint8_t iv[kAesBlockSize], uint8_t* out)
 {
-	aes_context ctx;
-	aes_setkey_enc(&ctx, key, 128);
-	aes_crypt_cbc(&ctx, AES_ENCRYPT, size, iv, in, out);
+	AesCbcEncrypt(in, size, AesKeySchedule(key, AesKeySchedule::USAGE_ENCRYPT), iv, out);
 }
 
-int Crypto::RsaSign(const sRsa1024Key & key, HashType hash_type, const uint8_t * hash, uint8_t signature[kRsa1024Size])
+void Crypto::AesCbcEncrypt(const uint8_t* in, uint64_t size, const AesKeySchedule& key, uint8_t iv[kAesBlockSize], uint8_t* out)
 {
-	int ret;
-	rsa_context ctx;
-	rsa_init(&ctx, RSA_PKCS_V15, 0);
+	if (key.use_aes_ni_)
+	{
+		AesNi::CbcEncrypt(key.enc_round_keys_, in, size, iv, out);
+		return;
+	}
 
-	ctx.len = kRsa1024Size;
-	mpi_read_binary(&ctx.D, key.priv_exponent, ctx.len);
-	mpi_read_binary(&ctx.N, key.modulus, ctx.len);
+	aes_crypt_cbc(const_cast<aes_context*>(&key.enc_ctx_), AES_ENCRYPT, size, iv, in, out);
+}
 
-	ret = rsa_rsassa_pkcs1_v15_sign(&ctx, RSA_PRIVATE, GetWrappedHashType(hash_type), GetWrappedHashSize(hash_type), hash, signature);
+// signing keys are prepared on first use, and only the few most recently used are kept, so private keys don't pile up in memory
+static const size_t kRsaKeyContextCacheLen = 4;
 
-	rsa_free(&ctx);
+template <class T>
+static std::shared_ptr<const RsaKeyContext> GetRsaKeyContext(const T& key)
+{
+	struct sCachedKey
+	{
+		T key;
+		std::shared_ptr<const RsaKeyContext> ctx;
+	};
+	static std::mutex cache_mutex;
+	static std::list<sCachedKey> cache; // front is most recently used
 
-	return ret;
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		for (auto itr = cache.begin(); itr != cache.end(); itr++)
+		{
+			if (memcmp(&itr->key, &key, sizeof(T)) == 0)
+			{
+				cache.splice(cache.begin(), cache, itr);
+				return cache.front().ctx;
+			}
+		}
+	}
+
+	// the context is shared, so one evicted by another thread stays valid until its last signature is done
+	std::shared_ptr<const RsaKeyContext> ctx = std::make_shared<RsaKeyContext>(key);
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	cache.push_front(sCachedKey());
+	cache.front().key = key;
+	cache.front().ctx = ctx;
+	while (cache.size() > kRsaKeyContextCacheLen)
+	{
+		cache.pop_back();
+	}
+	return ctx;
+}
+
+int Crypto::RsaSign(const sRsa1024Key & key, HashType hash_type, const uint8_t * hash, uint8_t signature[kRsa1024Size])
+{
+	return GetRsaKeyContext(key)->Sign(hash_type, hash, signature);
 }
 
 int Crypto::RsaVerify(const sRsa1024Key & key, HashType hash_type, const uint8_t * hash, const uint8_t signature[kRsa1024Size])
@@ -106,19 +429,7 @@ int Crypto::RsaVerify(const sRsa1024Key & key, HashType hash_type, const uint8_t
 
 int Crypto::RsaSign(const sRsa2048Key & key, HashType hash_type, const uint8_t * hash, uint8_t signature[kRsa2048Size])
 {
-	int ret;
-	rsa_context ctx;
-	rsa_init(&ctx, RSA_PKCS_V15, 0);
-
-	ctx.len = kRsa2048Size;
-	mpi_read_binary(&ctx.D, key.priv_exponent, ctx.len);
-	mpi_read_binary(&ctx.N, key.modulus, ctx.len);
-
-	ret = rsa_rsassa_pkcs1_v15_sign(&ctx, RSA_PRIVATE, GetWrappedHashType(hash_type), GetWrappedHashSize(hash_type), hash, signature);
-
-	rsa_free(&ctx);
-
-	return ret;
+	return GetRsaKeyContext(key)->Sign(hash_type, hash, signature);
 }
 
 int Crypto::RsaVerify(const sRsa2048Key & key, HashType hash_type, const uint8_t * hash, const uint8_t signature[kRsa2048Size])
@@ -142,19 +453,7 @@ int Crypto::RsaVerify(const sRsa2048Key & key, HashType hash_type, const uint8_t
 
 int Crypto::RsaSign(const sRsa4096Key & key, HashType hash_type, const uint8_t * hash, uint8_t signature[kRsa4096Size])
 {
-	int ret;
-	rsa_context ctx;
-	rsa_init(&ctx, RSA_PKCS_V15, 0);
-
-	ctx.len = kRsa4096Size;
-	mpi_read_binary(&ctx.D, key.priv_exponent, ctx.len);
-	mpi_read_binary(&ctx.N, key.modulus, ctx.len);
-
-	ret = rsa_rsassa_pkcs1_v15_sign(&ctx, RSA_PRIVATE, GetWrappedHashType(hash_type), GetWrappedHashSize(hash_type), hash, signature);
-
-	rsa_free(&ctx);
-
-	return ret;
+	return GetRsaKeyContext(key)->Sign(hash_type, hash, signature);
 }
 
 int Crypto::RsaVerify(const sRsa4096Key & key, HashType hash_type, const uint8_t * hash, const uint8_t signature[kRsa4096Size])
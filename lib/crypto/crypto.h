@@ -2,6 +2,8 @@
 #include <cstdint>
 #include <cstring>
 
+class AesKeySchedule;
+
 class Crypto
 {
 public:
@@ -44,12 +46,23 @@ public:
 		uint8_t modulus[kRsa1024Size];
 		uint8_t priv_exponent[kRsa1024Size];
 		uint8_t public_exponent[kRsaPublicExponentSize];
+		// optional CRT parameters, all zero when the key only has D
+		uint8_t prime_p[kRsa1024Size / 2];
+		uint8_t prime_q[kRsa1024Size / 2];
+		uint8_t exponent_dp[kRsa1024Size / 2];
+		uint8_t exponent_dq[kRsa1024Size / 2];
+		uint8_t coefficient_qp[kRsa1024Size / 2];
 
 		void operator=(const sRsa1024Key& other)
 		{
-			memcpy(this->modulus, modulus, kRsa1024Size);
-			memcpy(this->priv_exponent, priv_exponent, kRsa1024Size);
+			memcpy(this->modulus, other.modulus, kRsa1024Size);
+			memcpy(this->priv_exponent, other.priv_exponent, kRsa1024Size);
 			memcpy(this->public_exponent, other.public_exponent, kRsaPublicExponentSize);
+			memcpy(this->prime_p, other.prime_p, kRsa1024Size / 2);
+			memcpy(this->prime_q, other.prime_q, kRsa1024Size / 2);
+			memcpy(this->exponent_dp, other.exponent_dp, kRsa1024Size / 2);
+			memcpy(this->exponent_dq, other.exponent_dq, kRsa1024Size / 2);
+			memcpy(this->coefficient_qp, other.coefficient_qp, kRsa1024Size / 2);
 		}
 
 		bool operator==(const sRsa1024Key& other)
@@ -63,12 +76,23 @@ public:
 		uint8_t modulus[kRsa2048Size];
 		uint8_t priv_exponent[kRsa2048Size];
 		uint8_t public_exponent[kRsaPublicExponentSize];
+		// optional CRT parameters, all zero when the key only has D
+		uint8_t prime_p[kRsa2048Size / 2];
+		uint8_t prime_q[kRsa2048Size / 2];
+		uint8_t exponent_dp[kRsa2048Size / 2];
+		uint8_t exponent_dq[kRsa2048Size / 2];
+		uint8_t coefficient_qp[kRsa2048Size / 2];
 
 		void operator=(const sRsa2048Key& other)
 		{
 			memcpy(this->modulus, other.modulus, kRsa2048Size);
 			memcpy(this->priv_exponent, other.priv_exponent, kRsa2048Size);
 			memcpy(this->public_exponent, other.public_exponent, kRsaPublicExponentSize);
+			memcpy(this->prime_p, other.prime_p, kRsa2048Size / 2);
+			memcpy(this->prime_q, other.prime_q, kRsa2048Size / 2);
+			memcpy(this->exponent_dp, other.exponent_dp, kRsa2048Size / 2);
+			memcpy(this->exponent_dq, other.exponent_dq, kRsa2048Size / 2);
+			memcpy(this->coefficient_qp, other.coefficient_qp, kRsa2048Size / 2);
 		}
 
 		bool operator==(const sRsa2048Key& other)
@@ -82,12 +106,23 @@ public:
 		uint8_t modulus[kRsa4096Size];
 		uint8_t priv_exponent[kRsa4096Size];
 		uint8_t public_exponent[kRsaPublicExponentSize];
+		// optional CRT parameters, all zero when the key only has D
+		uint8_t prime_p[kRsa4096Size / 2];
+		uint8_t prime_q[kRsa4096Size / 2];
+		uint8_t exponent_dp[kRsa4096Size / 2];
+		uint8_t exponent_dq[kRsa4096Size / 2];
+		uint8_t coefficient_qp[kRsa4096Size / 2];
 
 		void operator=(const sRsa4096Key& other)
 		{
 			memcpy(this->modulus, other.modulus, kRsa4096Size);
 			memcpy(this->priv_exponent, other.priv_exponent, kRsa4096Size);
 			memcpy(this->public_exponent, other.public_exponent, kRsaPublicExponentSize);
+			memcpy(this->prime_p, other.prime_p, kRsa4096Size / 2);
+			memcpy(this->prime_q, other.prime_q, kRsa4096Size / 2);
+			memcpy(this->exponent_dp, other.exponent_dp, kRsa4096Size / 2);
+			memcpy(this->exponent_dq, other.exponent_dq, kRsa4096Size / 2);
+			memcpy(this->coefficient_qp, other.coefficient_qp, kRsa4096Size / 2);
 		}
 
 		bool operator==(const sRsa4096Key& other)
@@ -119,17 +154,52 @@ public:
 	};
 #pragma pack (pop)
 
+	// incremental hash state
+	static const size_t kShaBlockSize = 0x40;
+
+	struct sSha1Context
+	{
+		uint32_t state[5];
+		uint64_t length;
+		uint8_t buffer[kShaBlockSize];
+	};
+
+	struct sSha256Context
+	{
+		uint32_t state[8];
+		uint64_t length;
+		uint8_t buffer[kShaBlockSize];
+	};
+
 	static void Sha1(const uint8_t* in, uint64_t size, uint8_t hash[kSha1HashLen]);
 	static void Sha256(const uint8_t* in, uint64_t size, uint8_t hash[kSha256HashLen]);
-
-	// aes-128
+	static void Sha1Init(sSha1Context& ctx);
+	static void Sha1Update(sSha1Context& ctx, const uint8_t* in, uint64_t size);
+	static void Sha1Final(sSha1Context& ctx, uint8_t hash[kSha1HashLen]);
+	static void Sha256Init(sSha256Context& ctx);
+	static void Sha256Update(sSha256Context& ctx, const uint8_t* in, uint64_t size);
+	static void Sha256Final(sSha256Context& ctx, uint8_t hash[kSha256HashLen]);
+	// hashes block_num consecutive blocks of block_size bytes, hash i is written to hashes + i * kSha256HashLen
+	// large batches are split across threads of their own, code already running on a pool should use Sha256BatchSerial
+	static void Sha256Batch(const uint8_t* in, size_t block_num, size_t block_size, uint8_t* hashes);
+	static void Sha256BatchSerial(const uint8_t* in, size_t block_num, size_t block_size, uint8_t* hashes);
+
+	// aes-128, callers that reuse a key should prepare an AesKeySchedule once instead of passing the raw key
 	static void AesCtr(const uint8_t* in, uint64_t size, const uint8_t key[kAes128KeySize], uint8_t ctr[kAesBlockSize], uint8_t* out);
+	static void AesCtr(const uint8_t* in, uint64_t size, const AesKeySchedule& key, uint8_t ctr[kAesBlockSize], uint8_t* out);
+	// ctr is the counter for byte 0 of the stream and isn't modified, offset may be anywhere inside a block
+	static void AesCtr(const AesKeySchedule& key, const uint8_t ctr[kAesBlockSize], uint64_t offset, const uint8_t* in, uint64_t size, uint8_t* out);
 	static void AesIncrementCounter(const uint8_t in[kAesBlockSize], size_t block_num, uint8_t out[kAesBlockSize]);
 	
 	static void AesCbcDecrypt(const uint8_t* in, uint64_t size, const uint8_t key[kAes128KeySize], uint8_t iv[kAesBlockSize], uint8_t* out);
+	static void AesCbcDecrypt(const uint8_t* in, uint64_t size, const AesKeySchedule& key, uint8_t iv[kAesBlockSize], uint8_t* out);
+	// same result as AesCbcDecrypt, large inputs are split across threads (in and out may be the same buffer)
+	static void AesCbcDecryptParallel(const uint8_t* in, uint64_t size, const AesKeySchedule& key, uint8_t iv[kAesBlockSize], uint8_t* out);
 	static void AesCbcEncrypt(const uint8_t* in, uint64_t size, const uint8_t key[kAes128KeySize], uint8_t iv[kAesBlockSize], uint8_t* out);
+	static void AesCbcEncrypt(const uint8_t* in, uint64_t size, const AesKeySchedule& key, uint8_t iv[kAesBlockSize], uint8_t* out);
 
 
+	// rsa signing reuses a prepared RsaKeyContext per key, using the CRT when the key has P/Q
 	// rsa1024
 	static int RsaSign(const sRsa1024Key& key, HashType hash_type, const uint8_t* hash, uint8_t signature[kRsa1024Size]);
 	static int RsaVerify(const sRsa1024Key& key, HashType hash_type, const uint8_t* hash, const uint8_t signature[kRsa1024Size]);
@@ -144,6 +214,14 @@ public:
 	static int EcdsaVerify(const sEccPoint& key, HashType hash_type, const uint8_t* hash, const sEccPoint& signature);
 
 private:
+	static const size_t kSha256BatchMinThreadSize = 0x400000; // batches are only split across threads in pieces at least this large
+	static const size_t kAesCbcDecryptMinThreadSize = 0x400000; // likewise for parallel cbc decryption
+
+	static void Sha1ProcessBlocks(uint32_t state[5], const uint8_t* in, size_t block_num);
+	static void Sha256ProcessBlocks(uint32_t state[8], const uint8_t* in, size_t block_num);
+
+	friend class RsaKeyContext;
+
 	static int GetWrappedHashType(HashType type);
 	static uint32_t GetWrappedHashSize(HashType type);
 	static inline uint32_t getbe32(const uint8_t* data) { return data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3]; }
@@ -256,9 +256,10 @@
  * Do not use the Chinese Remainder Theorem for the RSA private operation.
  *
  * Uncomment this macro to disable the use of CRT in RSA.
+ * Keys without P/Q always take the non-CRT path.
  *
  */
-#define POLARSSL_RSA_NO_CRT
+//#define POLARSSL_RSA_NO_CRT
 
 
 /**
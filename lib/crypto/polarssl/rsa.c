@@ -273,31 +273,39 @@ int rsa_private( rsa_context *ctx,
         return( POLARSSL_ERR_RSA_BAD_INPUT_DATA );
     }
 
-#if defined(POLARSSL_RSA_NO_CRT)
-    MPI_CHK( mpi_exp_mod( &T, &T, &ctx->D, &ctx->N, &ctx->RN ) );
-#else
+#if !defined(POLARSSL_RSA_NO_CRT)
     /*
-     * faster decryption using the CRT
-     *
-     * T1 = input ^ dP mod P
-     * T2 = input ^ dQ mod Q
+     * keys loaded without their prime factors can only use D
      */
-    MPI_CHK( mpi_exp_mod( &T1, &T, &ctx->DP, &ctx->P, &ctx->RP ) );
-    MPI_CHK( mpi_exp_mod( &T2, &T, &ctx->DQ, &ctx->Q, &ctx->RQ ) );
-
-    /*
-     * T = (T1 - T2) * (Q^-1 mod P) mod P
-     */
-    MPI_CHK( mpi_sub_mpi( &T, &T1, &T2 ) );
-    MPI_CHK( mpi_mul_mpi( &T1, &T, &ctx->QP ) );
-    MPI_CHK( mpi_mod_mpi( &T, &T1, &ctx->P ) );
-
-    /*
-     * output = T2 + T * Q
-     */
-    MPI_CHK( mpi_mul_mpi( &T1, &T, &ctx->Q ) );
-    MPI_CHK( mpi_add_mpi( &T, &T2, &T1 ) );
+    if( mpi_cmp_int( &ctx->P, 0 ) != 0 )
+    {
+        /*
+         * faster decryption using the CRT
+         *
+         * T1 = input ^ dP mod P
+         * T2 = input ^ dQ mod Q
+         */
+        MPI_CHK( mpi_exp_mod( &T1, &T, &ctx->DP, &ctx->P, &ctx->RP ) );
+        MPI_CHK( mpi_exp_mod( &T2, &T, &ctx->DQ, &ctx->Q, &ctx->RQ ) );
+
+        /*
+         * T = (T1 - T2) * (Q^-1 mod P) mod P
+         */
+        MPI_CHK( mpi_sub_mpi( &T, &T1, &T2 ) );
+        MPI_CHK( mpi_mul_mpi( &T1, &T, &ctx->QP ) );
+        MPI_CHK( mpi_mod_mpi( &T, &T1, &ctx->P ) );
+
+        /*
+         * output = T2 + T * Q
+         */
+        MPI_CHK( mpi_mul_mpi( &T1, &T, &ctx->Q ) );
+        MPI_CHK( mpi_add_mpi( &T, &T2, &T1 ) );
+    }
+    else
 #endif
+    {
+        MPI_CHK( mpi_exp_mod( &T, &T, &ctx->D, &ctx->N, &ctx->RN ) );
+    }
 
     olen = ctx->len;
     MPI_CHK( mpi_write_binary( &T, output, olen ) );
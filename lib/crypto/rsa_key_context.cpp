@@ -0,0 +1,115 @@
+#include "rsa_key_context.h"
+
+RsaKeyContext::RsaKeyContext(const Crypto::sRsa1024Key& key)
+{
+	Prepare(Crypto::kRsa1024Size, key.modulus, key.priv_exponent, key.prime_p, key.prime_q, key.exponent_dp, key.exponent_dq, key.coefficient_qp);
+}
+
+RsaKeyContext::RsaKeyContext(const Crypto::sRsa2048Key& key)
+{
+	Prepare(Crypto::kRsa2048Size, key.modulus, key.priv_exponent, key.prime_p, key.prime_q, key.exponent_dp, key.exponent_dq, key.coefficient_qp);
+}
+
+RsaKeyContext::RsaKeyContext(const Crypto::sRsa4096Key& key)
+{
+	Prepare(Crypto::kRsa4096Size, key.modulus, key.priv_exponent, key.prime_p, key.prime_q, key.exponent_dp, key.exponent_dq, key.coefficient_qp);
+}
+
+RsaKeyContext::~RsaKeyContext()
+{
+	rsa_free(&ctx_);
+}
+
+bool RsaKeyContext::IsCrt() const
+{
+	return mpi_cmp_int(&ctx_.P, 0) != 0;
+}
+
+size_t RsaKeyContext::size() const
+{
+	return ctx_.len;
+}
+
+int RsaKeyContext::Sign(Crypto::HashType hash_type, const uint8_t* hash, uint8_t* signature) const
+{
+	// the polarssl signature takes a mutable context, but with R^2 already cached nothing in it is written
+	rsa_context* ctx = const_cast<rsa_context*>(&ctx_);
+	return rsa_rsassa_pkcs1_v15_sign(ctx, RSA_PRIVATE, Crypto::GetWrappedHashType(hash_type), Crypto::GetWrappedHashSize(hash_type), hash, signature);
+}
+
+void RsaKeyContext::Prepare(size_t size, const uint8_t* modulus, const uint8_t* priv_exponent, const uint8_t* prime_p, const uint8_t* prime_q, const uint8_t* exponent_dp, const uint8_t* exponent_dq, const uint8_t* coefficient_qp)
+{
+	rsa_init(&ctx_, RSA_PKCS_V15, 0);
+
+	ctx_.len = size;
+	mpi_read_binary(&ctx_.N, modulus, size);
+	mpi_read_binary(&ctx_.D, priv_exponent, size);
+	PrecomputeRR(&ctx_.RN, &ctx_.N);
+
+	if (IsZero(prime_p, size / 2) || IsZero(prime_q, size / 2))
+	{
+		return;
+	}
+
+	mpi_read_binary(&ctx_.P, prime_p, size / 2);
+	mpi_read_binary(&ctx_.Q, prime_q, size / 2);
+	mpi_read_binary(&ctx_.DP, exponent_dp, size / 2);
+	mpi_read_binary(&ctx_.DQ, exponent_dq, size / 2);
+	mpi_read_binary(&ctx_.QP, coefficient_qp, size / 2);
+
+	// CRT values that don't match the key would silently produce bad signatures, fall back to D instead
+	bool is_valid = IsCrtValid();
+
+	if (!is_valid || PrecomputeRR(&ctx_.RP, &ctx_.P) != 0 || PrecomputeRR(&ctx_.RQ, &ctx_.Q) != 0)
+	{
+		mpi_free(&ctx_.P);
+		mpi_free(&ctx_.Q);
+		mpi_free(&ctx_.DP);
+		mpi_free(&ctx_.DQ);
+		mpi_free(&ctx_.QP);
+		mpi_free(&ctx_.RP);
+		mpi_free(&ctx_.RQ);
+	}
+}
+
+bool RsaKeyContext::IsCrtValid() const
+{
+	// N = P*Q, DP = D mod (P-1), DQ = D mod (Q-1) and QP*Q = 1 mod P
+	mpi t, p1, q1;
+	mpi_init(&t);
+	mpi_init(&p1);
+	mpi_init(&q1);
+
+	bool is_valid = mpi_mul_mpi(&t, &ctx_.P, &ctx_.Q) == 0 && mpi_cmp_mpi(&t, &ctx_.N) == 0
+		&& mpi_sub_int(&p1, &ctx_.P, 1) == 0 && mpi_mod_mpi(&t, &ctx_.D, &p1) == 0 && mpi_cmp_mpi(&t, &ctx_.DP) == 0
+		&& mpi_sub_int(&q1, &ctx_.Q, 1) == 0 && mpi_mod_mpi(&t, &ctx_.D, &q1) == 0 && mpi_cmp_mpi(&t, &ctx_.DQ) == 0
+		&& mpi_mul_mpi(&t, &ctx_.QP, &ctx_.Q) == 0 && mpi_mod_mpi(&t, &t, &ctx_.P) == 0 && mpi_cmp_int(&t, 1) == 0;
+
+	mpi_free(&t);
+	mpi_free(&p1);
+	mpi_free(&q1);
+	return is_valid;
+}
+
+bool RsaKeyContext::IsZero(const uint8_t* data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		if (data[i] != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int RsaKeyContext::PrecomputeRR(mpi* rr, const mpi* n)
+{
+	// same value mpi_exp_mod() caches on its first call: R^2 mod N with R = 2^(limb bits * limb count)
+	int ret;
+	if ((ret = mpi_lset(rr, 1)) != 0 || (ret = mpi_shift_l(rr, n->n * 2 * sizeof(t_uint) * 8)) != 0 || (ret = mpi_mod_mpi(rr, rr, n)) != 0)
+	{
+		mpi_free(rr);
+	}
+	return ret;
+}
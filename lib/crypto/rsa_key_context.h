@@ -0,0 +1,35 @@
+#pragma once
+#include "crypto.h"
+#include "polarssl/rsa.h"
+
+/*
+ RSA private key prepared once for repeated PKCS#1 v1.5 signing.
+ Keys that carry P/Q/DP/DQ/QP are signed with the CRT, and the Montgomery
+ constants are computed up front, so Sign() only reads the context and is
+ safe to call from several threads.
+*/
+class RsaKeyContext
+{
+public:
+	RsaKeyContext(const Crypto::sRsa1024Key& key);
+	RsaKeyContext(const Crypto::sRsa2048Key& key);
+	RsaKeyContext(const Crypto::sRsa4096Key& key);
+	~RsaKeyContext();
+
+	bool IsCrt() const;
+	size_t size() const;
+
+	// signature must be size() bytes
+	int Sign(Crypto::HashType hash_type, const uint8_t* hash, uint8_t* signature) const;
+
+private:
+	RsaKeyContext(const RsaKeyContext&) = delete;
+	RsaKeyContext& operator=(const RsaKeyContext&) = delete;
+
+	rsa_context ctx_;
+
+	void Prepare(size_t size, const uint8_t* modulus, const uint8_t* priv_exponent, const uint8_t* prime_p, const uint8_t* prime_q, const uint8_t* exponent_dp, const uint8_t* exponent_dq, const uint8_t* coefficient_qp);
+	bool IsCrtValid() const;
+	static bool IsZero(const uint8_t* data, size_t size);
+	static int PrecomputeRR(mpi* rr, const mpi* n);
+};
@@ -0,0 +1,214 @@
+#include "sha256_multi_buffer.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SHAMB_ARCH_X86
+#endif
+
+#ifdef SHAMB_ARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHAMB_TARGET
+#else
+// only these functions are built for AVX2, the rest of the library stays generic
+#define SHAMB_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef SHAMB_ARCH_X86
+static const size_t kChunkSize = 0x40;
+
+static const uint32_t kRoundConstants[64] =
+{
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static const uint32_t kInitialState[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+
+#define SHAMB_ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+// loads 32 bytes from each lane and transposes them, so w[i] holds word i of every lane
+SHAMB_TARGET static inline void LoadWords(const uint8_t* const lanes[Sha256MultiBuffer::kLaneNum], size_t offset, __m256i w[8])
+{
+	const __m256i kByteSwap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+	__m256i r[8];
+	for (size_t i = 0; i < 8; i++)
+	{
+		r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(lanes[i] + offset)), kByteSwap);
+	}
+
+	__m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+	__m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+	__m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+	__m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+	__m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+	__m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+	__m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+	__m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+	__m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+	__m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+	__m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+	__m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+	w[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+	w[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+	w[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+	w[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+	w[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	w[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	w[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	w[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+SHAMB_TARGET static void ProcessChunks(__m256i state[8], const uint8_t* const lanes[Sha256MultiBuffer::kLaneNum], size_t chunk_num)
+{
+	for (size_t chunk = 0; chunk < chunk_num; chunk++)
+	{
+		__m256i w[16];
+		LoadWords(lanes, chunk * kChunkSize, w);
+		LoadWords(lanes, chunk * kChunkSize + 32, w + 8);
+
+		__m256i a = state[0], b = state[1], c = state[2], d = state[3];
+		__m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+		for (int t = 0; t < 64; t++)
+		{
+			// message schedule, kept as a 16 entry ring
+			if (t >= 16)
+			{
+				__m256i w15 = w[(t - 15) & 15];
+				__m256i w2 = w[(t - 2) & 15];
+				__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(SHAMB_ROR(w15, 7), SHAMB_ROR(w15, 18)), _mm256_srli_epi32(w15, 3));
+				__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(SHAMB_ROR(w2, 17), SHAMB_ROR(w2, 19)), _mm256_srli_epi32(w2, 10));
+				w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+			}
+
+			__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(SHAMB_ROR(e, 6), SHAMB_ROR(e, 11)), SHAMB_ROR(e, 25));
+			__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+			__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, _mm256_add_epi32(w[t & 15], _mm256_set1_epi32((int)kRoundConstants[t]))));
+			__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(SHAMB_ROR(a, 2), SHAMB_ROR(a, 13)), SHAMB_ROR(a, 22));
+			__m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+			__m256i t2 = _mm256_add_epi32(s0, maj);
+
+			h = g;
+			g = f;
+			f = e;
+			e = _mm256_add_epi32(d, t1);
+			d = c;
+			c = b;
+			b = a;
+			a = _mm256_add_epi32(t1, t2);
+		}
+
+		state[0] = _mm256_add_epi32(state[0], a);
+		state[1] = _mm256_add_epi32(state[1], b);
+		state[2] = _mm256_add_epi32(state[2], c);
+		state[3] = _mm256_add_epi32(state[3], d);
+		state[4] = _mm256_add_epi32(state[4], e);
+		state[5] = _mm256_add_epi32(state[5], f);
+		state[6] = _mm256_add_epi32(state[6], g);
+		state[7] = _mm256_add_epi32(state[7], h);
+	}
+}
+#endif
+
+bool Sha256MultiBuffer::IsSupported()
+{
+#ifdef SHAMB_ARCH_X86
+#ifdef _MSC_VER
+	struct Detect
+	{
+		static bool Run()
+		{
+			// avx2 also needs the OS to save the ymm registers
+			int info[4];
+			__cpuid(info, 1);
+			if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+			{
+				return false;
+			}
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+		}
+	};
+	static const bool is_supported = Detect::Run();
+#else
+	static const bool is_supported = __builtin_cpu_supports("avx2") != 0;
+#endif
+	return is_supported;
+#else
+	return false;
+#endif
+}
+
+#ifdef SHAMB_ARCH_X86
+SHAMB_TARGET void Sha256MultiBuffer::HashLanes(const uint8_t* in, size_t msg_size, uint8_t hashes[kLaneNum * kHashLen])
+{
+	__m256i state[8];
+	for (size_t i = 0; i < 8; i++)
+	{
+		state[i] = _mm256_set1_epi32((int)kInitialState[i]);
+	}
+
+	// whole chunks straight from the input
+	const uint8_t* lanes[kLaneNum];
+	for (size_t i = 0; i < kLaneNum; i++)
+	{
+		lanes[i] = in + i * msg_size;
+	}
+	ProcessChunks(state, lanes, msg_size / kChunkSize);
+
+	// every lane has the same length, so the padded tail has the same shape in each
+	size_t tail_size = msg_size % kChunkSize;
+	size_t tail_chunk_num = tail_size + 1 + 8 > kChunkSize ? 2 : 1;
+	uint64_t bit_length = (uint64_t)msg_size << 3;
+
+	uint8_t tail[kLaneNum][kChunkSize * 2];
+	for (size_t i = 0; i < kLaneNum; i++)
+	{
+		memset(tail[i], 0, sizeof(tail[i]));
+		memcpy(tail[i], lanes[i] + (msg_size - tail_size), tail_size);
+		tail[i][tail_size] = 0x80;
+		for (size_t j = 0; j < 8; j++)
+		{
+			tail[i][tail_chunk_num * kChunkSize - 1 - j] = (uint8_t)(bit_length >> (j * 8));
+		}
+		lanes[i] = tail[i];
+	}
+	ProcessChunks(state, lanes, tail_chunk_num);
+
+	// state[i] holds word i of every lane
+	uint32_t words[8][kLaneNum];
+	for (size_t i = 0; i < 8; i++)
+	{
+		_mm256_storeu_si256((__m256i*)words[i], state[i]);
+	}
+	for (size_t lane = 0; lane < kLaneNum; lane++)
+	{
+		for (size_t i = 0; i < 8; i++)
+		{
+			uint8_t* out = hashes + lane * kHashLen + i * 4;
+			out[0] = (uint8_t)(words[i][lane] >> 24);
+			out[1] = (uint8_t)(words[i][lane] >> 16);
+			out[2] = (uint8_t)(words[i][lane] >> 8);
+			out[3] = (uint8_t)(words[i][lane]);
+		}
+	}
+}
+#else
+// never called, IsSupported() is false off x86
+void Sha256MultiBuffer::HashLanes(const uint8_t* in, size_t msg_size, uint8_t hashes[kLaneNum * kHashLen]) {}
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+/*
+ SHA-256 of 8 independent, equally sized messages at once, one per
+ 32bit lane of an AVX2 register.
+ Callers must check IsSupported() first.
+*/
+class Sha256MultiBuffer
+{
+public:
+	static const size_t kLaneNum = 8;
+	static const size_t kHashLen = 0x20;
+
+	static bool IsSupported();
+
+	// hashes kLaneNum consecutive messages of msg_size bytes starting at in
+	static void HashLanes(const uint8_t* in, size_t msg_size, uint8_t hashes[kLaneNum * kHashLen]);
+};
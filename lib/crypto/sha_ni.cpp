@@ -0,0 +1,175 @@
+#include "sha_ni.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SHANI_ARCH_X86
+#endif
+
+#ifdef SHANI_ARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHANI_TARGET
+#else
+#include <cpuid.h>
+// only these functions are built for the SHA extensions, the rest of the library stays generic
+#define SHANI_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+#endif
+
+#ifdef SHANI_ARCH_X86
+static const uint32_t kSha256RoundConstants[64] =
+{
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static void Cpuid(int leaf, int subleaf, int info[4])
+{
+#ifdef _MSC_VER
+	__cpuidex(info, leaf, subleaf);
+#else
+	unsigned int a = 0, b = 0, c = 0, d = 0;
+	if (__get_cpuid_count(leaf, subleaf, &a, &b, &c, &d) == 0)
+	{
+		a = b = c = d = 0;
+	}
+	info[0] = a; info[1] = b; info[2] = c; info[3] = d;
+#endif
+}
+#endif
+
+bool ShaNi::IsSupported()
+{
+#ifdef SHANI_ARCH_X86
+	struct Detect
+	{
+		static bool Run()
+		{
+			int info[4];
+			Cpuid(1, 0, info);
+			bool has_sse41 = (info[2] & (1 << 19)) != 0;
+			Cpuid(7, 0, info);
+			bool has_sha = (info[1] & (1 << 29)) != 0;
+			return has_sse41 && has_sha;
+		}
+	};
+	static const bool is_supported = Detect::Run();
+	return is_supported;
+#else
+	return false;
+#endif
+}
+
+#ifdef SHANI_ARCH_X86
+// 4 rounds of sha1, the round function selector must be an immediate so it is a template parameter
+template <int kFunc>
+SHANI_TARGET static inline void Sha1RoundGroup(int i, const uint8_t* in, __m128i msg[4], __m128i& abcd, __m128i& abcd_prev, __m128i& e)
+{
+	const __m128i kByteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+	// the message schedule is extended 4 words per group
+	__m128i w;
+	if (i < 4)
+	{
+		w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + i * 16)), kByteSwap);
+	}
+	else
+	{
+		w = _mm_sha1msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+		w = _mm_xor_si128(w, msg[(i + 2) & 3]);
+		w = _mm_sha1msg2_epu32(w, msg[(i + 3) & 3]);
+	}
+	msg[i & 3] = w;
+
+	// the first group adds e directly, later ones derive it from the state 4 rounds back
+	e = i == 0 ? _mm_add_epi32(e, w) : _mm_sha1nexte_epu32(abcd_prev, w);
+	abcd_prev = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e, kFunc);
+}
+
+SHANI_TARGET void ShaNi::Sha1ProcessBlocks(uint32_t state[5], const uint8_t* in, size_t block_num)
+{
+	// abcd is kept with a in the top lane, e rides in the top lane of its own register
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+	__m128i e = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	for (size_t block = 0; block < block_num; block++, in += kBlockSize)
+	{
+		__m128i abcd_save = abcd;
+		__m128i e_save = e;
+
+		// 20 groups of 4 rounds, 5 groups per round function
+		__m128i msg[4];
+		__m128i abcd_prev = abcd;
+		int i = 0;
+		for (; i < 5; i++) Sha1RoundGroup<0>(i, in, msg, abcd, abcd_prev, e);
+		for (; i < 10; i++) Sha1RoundGroup<1>(i, in, msg, abcd, abcd_prev, e);
+		for (; i < 15; i++) Sha1RoundGroup<2>(i, in, msg, abcd, abcd_prev, e);
+		for (; i < 20; i++) Sha1RoundGroup<3>(i, in, msg, abcd, abcd_prev, e);
+
+		e = _mm_add_epi32(_mm_sha1nexte_epu32(abcd_prev, _mm_setzero_si128()), e_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32_t)_mm_extract_epi32(e, 3);
+}
+
+SHANI_TARGET void ShaNi::Sha256ProcessBlocks(uint32_t state[8], const uint8_t* in, size_t block_num)
+{
+	const __m128i kByteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	// the sha256 instructions work on the state as abef/cdgh
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1); // cdab
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B); // efgh
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // abef
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0); // cdgh
+
+	for (size_t block = 0; block < block_num; block++, in += kBlockSize)
+	{
+		__m128i state0_save = state0;
+		__m128i state1_save = state1;
+
+		// 16 groups of 4 rounds, the message schedule is extended 4 words per group
+		__m128i msg[4];
+		for (int i = 0; i < 16; i++)
+		{
+			__m128i w;
+			if (i < 4)
+			{
+				w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + i * 16)), kByteSwap);
+			}
+			else
+			{
+				w = _mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+				w = _mm_add_epi32(w, _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+				w = _mm_sha256msg2_epu32(w, msg[(i + 3) & 3]);
+			}
+			msg[i & 3] = w;
+
+			__m128i wk = _mm_add_epi32(w, _mm_loadu_si128((const __m128i*)&kSha256RoundConstants[i * 4]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+		}
+
+		state0 = _mm_add_epi32(state0, state0_save);
+		state1 = _mm_add_epi32(state1, state1_save);
+	}
+
+	// back to abcd/efgh
+	tmp = _mm_shuffle_epi32(state0, 0x1B); // feba
+	state1 = _mm_shuffle_epi32(state1, 0xB1); // dchg
+	_mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xF0)); // dcba
+	_mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8)); // hgfe
+}
+#else
+// never called, IsSupported() is false off x86
+void ShaNi::Sha1ProcessBlocks(uint32_t state[5], const uint8_t* in, size_t block_num) {}
+void ShaNi::Sha256ProcessBlocks(uint32_t state[8], const uint8_t* in, size_t block_num) {}
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+/*
+ SHA-1/SHA-256 block functions using the x86 SHA extensions.
+ Callers must check IsSupported() first. The state is the native word
+ array used by Crypto's incremental contexts.
+*/
+class ShaNi
+{
+public:
+	static const size_t kBlockSize = 0x40;
+
+	static bool IsSupported();
+
+	static void Sha1ProcessBlocks(uint32_t state[5], const uint8_t* in, size_t block_num);
+	static void Sha256ProcessBlocks(uint32_t state[8], const uint8_t* in, size_t block_num);
+};
@@ -220,6 +220,13 @@ void CciHeader::DeserialiseHeader(const u8 * cci_data)
 	}
 }
 
+void CciHeader::DeserialiseHeader(IoStream& stream, u64 offset)
+{
+	u8 data[sizeof(sSignedCciHeader)];
+	stream.read(offset, sizeof(sSignedCciHeader), data);
+	DeserialiseHeader(data);
+}
+
 bool CciHeader::ValidateSignature(const Crypto::sRsa2048Key & ncsd_rsa_key) const
 {
 	const struct sSignedCciHeader* data = (const struct sSignedCciHeader*)serialised_data_.data();
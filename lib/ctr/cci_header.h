@@ -1,6 +1,7 @@
 #pragma once
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
 #include <crypto/crypto.h>
 
 class CciHeader
@@ -71,6 +72,7 @@ public:
 
 	// Header Deserialisation
 	void DeserialiseHeader(const u8* cci_data);
+	void DeserialiseHeader(IoStream& stream, u64 offset);
 	bool ValidateSignature(const Crypto::sRsa2048Key& ncsd_rsa_key) const;
 	u64 GetMediaCapacity() const;
 	u64 GetCciUsedSize() const;
@@ -1,3 +1,8 @@
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <fnd/bounded_queue.h>
+#include <fnd/thread_pool.h>
 #include <es/es_version.h>
 #include "cia_builder.h"
 
@@ -54,6 +59,8 @@ void CiaBuilder::MakeTmd()
 	tmd_.SetTitleType(ESTmd::ES_TITLE_TYPE_CTR);
 
 
+	// the content list is rebuilt once the content hashes are known
+	tmd_.ClearContentList();
 	total_content_size_ = 0;
 	for (size_t i = 0; i < content_.size(); i++) {
 		total_content_size_ += content_[i].GetSize();
@@ -63,6 +70,10 @@ void CiaBuilder::MakeTmd()
 	tmd_.SetIssuer(tmd_sign_.cert.GetChildIssuer());
 	tmd_.SetCaCrlVersion(0);
 	tmd_.SetSignerCrlVersion(0);
+}
+
+void CiaBuilder::SignTmd()
+{
 	tmd_.SerialiseTmd(tmd_sign_.rsa_key);
 }
 
@@ -70,7 +81,7 @@ void CiaBuilder::MakeHeader()
 {	
 	header_.SetCertificateChainSize(certs_.GetSerialisedDataSize());
 	header_.SetTicketSize(tik_.GetSerialisedDataSize());
-	header_.SetTmdSize(tmd_.GetSerialisedDataSize());
+	header_.SetTmdSize(tmd_.PredictSerialisedDataSize()); // signed once the content hashes are known
 	header_.SetFooterSize(footer_.GetSerialisedDataSize());
 	header_.SetContentSize(total_content_size_);
 	// enable all contents' indexes
@@ -81,21 +92,259 @@ void CiaBuilder::MakeHeader()
 	header_.SerialiseHeader();
 }
 
-void CiaBuilder::WriteContentBlockToFile(const u8* data, size_t size, bool encrypted, FILE * fp)
+size_t CiaBuilder::GetContentThreadNum() const
+{
+	size_t thread_num = thread_num_ > 0 ? thread_num_ : ThreadPool::default_thread_num();
+	if (thread_num > content_.size())
+	{
+		thread_num = content_.size();
+	}
+	return thread_num > 0 ? thread_num : 1;
+}
+
+void CiaBuilder::WriteContentToFile(OutputFile& file, size_t index, u64 file_offset, ESContent::sHashContext& hash_ctx)
 {
-	if (size > kIoBufferLen) return;
+	const ESContent& content = content_[index];
+	bool is_content_encrypted = content.IsFlagSet(ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED);
+
+	// read -> hash -> encrypt -> write, each stage on its own thread
+	// blocks cycle back to the free queue once written, bounding the data in flight
+	std::vector<sContentBlock> blocks(kPipelineDepth);
+	BoundedQueue<sContentBlock*> free_queue(kPipelineDepth);
+	BoundedQueue<sContentBlock*> hash_queue(kPipelineDepth);
+	BoundedQueue<sContentBlock*> crypt_queue(kPipelineDepth);
+	BoundedQueue<sContentBlock*> write_queue(kPipelineDepth);
+	for (auto& block : blocks)
+	{
+		block.buffer.resize(kIoBufferLen);
+		free_queue.push(&block);
+	}
+
+	// the first error stops every stage
+	std::mutex error_mutex;
+	std::exception_ptr error;
+	auto fail = [&](std::exception_ptr e)
+	{
+		std::lock_guard<std::mutex> lock(error_mutex);
+		if (error == nullptr)
+		{
+			error = e;
+		}
+		free_queue.close();
+		hash_queue.close();
+		crypt_queue.close();
+		write_queue.close();
+	};
+
+	std::thread hasher([&]()
+	{
+		try
+		{
+			hash_ctx.init(content.IsSha1Hash());
+
+			sContentBlock* block;
+			while (hash_queue.pop(block))
+			{
+				// the block is hashed before it is handed on to be encrypted in place
+				hash_ctx.update(block->data, block->size);
+				if (crypt_queue.push(block) == false)
+				{
+					break;
+				}
+			}
+			crypt_queue.close();
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+		}
+	});
+
+	std::thread crypter([&]()
+	{
+		try
+		{
+			// the iv is carried between blocks by the cbc function
+			u8 iv[Crypto::kAesBlockSize];
+			ESCrypto::SetupContentAesIv(content.GetContentIndex(), iv);
+
+			sContentBlock* block;
+			while (crypt_queue.pop(block))
+			{
+				if (is_content_encrypted)
+				{
+					Crypto::AesCbcEncrypt(block->data, block->size, titlekey_schedule_, iv, block->buffer.data());
+					block->out = block->buffer.data();
+				}
+				else
+				{
+					block->out = block->data;
+				}
+
+				if (write_queue.push(block) == false)
+				{
+					break;
+				}
+			}
+			write_queue.close();
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+		}
+	});
+
+	std::thread writer([&]()
+	{
+		try
+		{
+			sContentBlock* block;
+			while (write_queue.pop(block))
+			{
+				file.write_at(file_offset + block->offset, block->out, block->size);
+				if (free_queue.push(block) == false)
+				{
+					break;
+				}
+			}
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+		}
+	});
+
+	// read stage, in memory content is referenced in place
+	try
+	{
+		// empty content still passes one block through, so every stage sees it
+		u64 pos = 0;
+		do
+		{
+			sContentBlock* block;
+			if (free_queue.pop(block) == false)
+			{
+				break;
+			}
+
+			block->offset = pos;
+			block->size = (content.GetSize() - pos) < kIoBufferLen ? (size_t)(content.GetSize() - pos) : kIoBufferLen;
+			if (content.IsStreamBacked())
+			{
+				content.ReadData(pos, block->size, block->buffer.data());
+				block->data = block->buffer.data();
+			}
+			else
+			{
+				block->data = content.GetData() + pos;
+			}
+
+			if (hash_queue.push(block) == false)
+			{
+				break;
+			}
+			pos += block->size;
+		} while (pos < content.GetSize());
+		hash_queue.close();
+	}
+	catch (...)
+	{
+		fail(std::current_exception());
+	}
 
-	if (encrypted) {
-		Crypto::AesCbcEncrypt(data, size, titlekey_, content_iv_, io_buffer);
-		fwrite(io_buffer, size, 1, fp);
+	hasher.join();
+	crypter.join();
+	writer.join();
+
+	if (error != nullptr)
+	{
+		std::rethrow_exception(error);
 	}
-	else {
-		fwrite(data, size, 1, fp);
+}
+
+void CiaBuilder::WriteContentToFileSerial(OutputFile& file, size_t index, u64 file_offset, ESContent::sHashContext& hash_ctx)
+{
+	const ESContent& content = content_[index];
+	bool is_content_encrypted = content.IsFlagSet(ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED);
+
+	u8 iv[Crypto::kAesBlockSize];
+	ESCrypto::SetupContentAesIv(content.GetContentIndex(), iv);
+	hash_ctx.init(content.IsSha1Hash());
+
+	// read, hash, encrypt and write each block in turn, for callers that already run one build per core
+	std::vector<u8> buffer(kIoBufferLen);
+	for (u64 pos = 0; pos < content.GetSize(); pos += kIoBufferLen)
+	{
+		size_t block_size = (content.GetSize() - pos) < kIoBufferLen ? (size_t)(content.GetSize() - pos) : kIoBufferLen;
+
+		const u8* data = content.GetData() + pos;
+		if (content.IsStreamBacked())
+		{
+			content.ReadData(pos, block_size, buffer.data());
+			data = buffer.data();
+		}
+
+		hash_ctx.update(data, block_size);
+		if (is_content_encrypted)
+		{
+			Crypto::AesCbcEncrypt(data, block_size, titlekey_schedule_, iv, buffer.data());
+			data = buffer.data();
+		}
+		file.write_at(file_offset + pos, data, block_size);
 	}
 }
 
+void CiaBuilder::WriteContentToBuffer(u8* out, size_t index, ESContent::sHashContext& hash_ctx)
+{
+	const ESContent& content = content_[index];
+	bool is_content_encrypted = content.IsFlagSet(ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED);
+
+	u8 iv[Crypto::kAesBlockSize];
+	ESCrypto::SetupContentAesIv(content.GetContentIndex(), iv);
+	hash_ctx.init(content.IsSha1Hash());
+
+	// each block is read, hashed and encrypted while it is still in cache
+	for (u64 pos = 0; pos < content.GetSize(); pos += kIoBufferLen)
+	{
+		size_t block_size = (content.GetSize() - pos) < kIoBufferLen ? (size_t)(content.GetSize() - pos) : kIoBufferLen;
+
+		// stream backed content is read straight into place and encrypted there
+		const u8* data = content.GetData() + pos;
+		if (content.IsStreamBacked())
+		{
+			content.ReadData(pos, block_size, out + pos);
+			data = out + pos;
+		}
+
+		hash_ctx.update(data, block_size);
+		if (is_content_encrypted)
+		{
+			Crypto::AesCbcEncrypt(data, block_size, titlekey_schedule_, iv, out + pos);
+		}
+		else if (data != out + pos)
+		{
+			memcpy(out + pos, data, block_size);
+		}
+	}
+}
 
-CiaBuilder::CiaBuilder()
+void CiaBuilder::UpdateContentHashes(std::vector<ESContent::sHashContext>& hash_ctx)
+{
+	for (size_t i = 0; i < content_.size(); i++)
+	{
+		u8 hash[Crypto::kSha256HashLen];
+		hash_ctx[i].final(hash);
+		content_[i].SetContentHash(hash);
+	}
+
+	// the tmd is only signed here, its size was fixed by CreateCia()
+	MakeTmd();
+	SignTmd();
+}
+
+
+CiaBuilder::CiaBuilder() :
+	thread_num_(0)
 {
 }
 
@@ -113,56 +362,63 @@ void CiaBuilder::CreateCia()
 
 void CiaBuilder::WriteToFile(const std::string & path)
 {
-	FILE* fp;
-
-	fp = fopen(path.c_str(), "wb");
-	if (fp == NULL)
-	{
-		throw ProjectSnakeException(kModuleName, "Failed to open " + path + " for writing");
-	}
-
-	u8 padding[0x400] = { 0 };
-
-	// header
-	fwrite(header_.GetSerialisedData(), header_.GetSerialisedDataSize(), 1, fp);
-	fwrite(padding, header_.GetCertificateChainOffset() - header_.GetSerialisedDataSize(), 1, fp);
-
-	// certificates
-	fwrite(certs_.GetSerialisedData(), certs_.GetSerialisedDataSize(), 1, fp);
-	fwrite(padding, header_.GetTicketOffset() - (header_.GetCertificateChainOffset() + header_.GetCertificateChainSize()), 1, fp);
-
-	// ticket
-	fwrite(tik_.GetSerialisedData(), tik_.GetSerialisedDataSize(), 1, fp);
-	fwrite(padding, header_.GetTmdOffset() - (header_.GetTicketOffset() + header_.GetTicketSize()), 1, fp);
+	WriteToFile(path, OutputFile::SYNC_NONE);
+}
 
-	// tmd
-	fwrite(tmd_.GetSerialisedData(), tmd_.GetSerialisedDataSize(), 1, fp);
-	fwrite(padding, header_.GetContentOffset() - (header_.GetTmdOffset() + header_.GetTmdSize()), 1, fp);
+void CiaBuilder::WriteToFile(const std::string & path, OutputFile::SyncPolicy sync_policy)
+{
+	OutputFile file(path, header_.GetPredictedCiaSize(), sync_policy);
 
-	// content
-	for (size_t i = 0; i < content_.size(); i++) {
-		bool is_content_encrypted = content_[i].IsFlagSet(ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED);
+	// header, certificates, ticket and tmd are written as one run, each followed by its alignment padding
+	OutputFile::sIoVec sections[] =
+	{
+		{ header_.GetSerialisedData(), header_.GetSerialisedDataSize() },
+		{ nullptr, header_.GetCertificateChainOffset() - header_.GetSerialisedDataSize() },
+		{ certs_.GetSerialisedData(), certs_.GetSerialisedDataSize() },
+		{ nullptr, header_.GetTicketOffset() - (header_.GetCertificateChainOffset() + header_.GetCertificateChainSize()) },
+		{ tik_.GetSerialisedData(), tik_.GetSerialisedDataSize() },
+		{ nullptr, header_.GetTmdOffset() - (header_.GetTicketOffset() + header_.GetTicketSize()) },
+		{ nullptr, header_.GetTmdSize() },
+		{ nullptr, header_.GetContentOffset() - (header_.GetTmdOffset() + header_.GetTmdSize()) },
+	};
+	file.write(sections, sizeof(sections) / sizeof(OutputFile::sIoVec));
+
+	// content is filled in below
+	file.skip(header_.GetContentSize());
 
-		if (is_content_encrypted) {
-			ESCrypto::SetupContentAesIv(content_[i].GetContentIndex(), content_iv_);
-		}
+	// footer
+	if (header_.GetFooterSize() > 0) {
+		file.pad(header_.GetFooterOffset() - (header_.GetContentOffset() + header_.GetContentSize()));
+		file.write(footer_.GetSerialisedData(), footer_.GetSerialisedDataSize());
+	}
 
-		// write blocks
-		for (size_t j = 0; j < (content_[i].GetSize() / kIoBufferLen); j++) {
-			WriteContentBlockToFile(content_[i].GetData() + (kIoBufferLen * j), kIoBufferLen, is_content_encrypted, fp);
+	// content has an iv per content index, so each is hashed, encrypted and written to its offset independently
+	std::vector<ESContent::sHashContext> hash_ctx(content_.size());
+	u64 offset = header_.GetContentOffset();
+	if (thread_num_ == 1)
+	{
+		for (size_t i = 0; i < content_.size(); i++)
+		{
+			WriteContentToFileSerial(file, i, offset, hash_ctx[i]);
+			offset += content_[i].GetSize();
 		}
-
-		// write final unaligned block
-		if (content_[i].GetSize() % kIoBufferLen) {
-			WriteContentBlockToFile(content_[i].GetData() + ((content_[i].GetSize() / kIoBufferLen) * kIoBufferLen), content_[i].GetSize() % kIoBufferLen, is_content_encrypted, fp);
+	}
+	else
+	{
+		ThreadPool pool(GetContentThreadNum());
+		for (size_t i = 0; i < content_.size(); i++)
+		{
+			pool.submit([this, &file, &hash_ctx, i, offset]() { WriteContentToFile(file, i, offset, hash_ctx[i]); });
+			offset += content_[i].GetSize();
 		}
+		pool.wait();
 	}
 
-	// footer
-	if (header_.GetFooterSize() > 0) {
-		fwrite(padding, header_.GetFooterOffset() - (header_.GetContentOffset() + header_.GetContentSize()), 1, fp);
-		fwrite(footer_.GetSerialisedData(), footer_.GetSerialisedDataSize(), 1, fp);
-	}
+	// the tmd is left blank above until the content has been hashed
+	UpdateContentHashes(hash_ctx);
+	file.write_at(header_.GetTmdOffset(), tmd_.GetSerialisedData(), tmd_.GetSerialisedDataSize());
+
+	file.commit();
 }
 
 void CiaBuilder::WriteToBuffer(MemoryBlob& out)
@@ -177,46 +433,76 @@ void CiaBuilder::WriteToBuffer(MemoryBlob& out)
 	memcpy(out.data() + 0x0, header_.GetSerialisedData(), header_.GetSerialisedDataSize());
 	memcpy(out.data() + header_.GetCertificateChainOffset(), certs_.GetSerialisedData(), certs_.GetSerialisedDataSize());
 	memcpy(out.data() + header_.GetTicketOffset(), tik_.GetSerialisedData(), tik_.GetSerialisedDataSize());
-	memcpy(out.data() + header_.GetTmdOffset(), tmd_.GetSerialisedData(), tmd_.GetSerialisedDataSize());
 	memcpy(out.data() + header_.GetFooterOffset(), footer_.GetSerialisedData(), footer_.GetSerialisedDataSize());
 
-	u64 pos = header_.GetContentOffset();
-	for (size_t i = 0; i < content_.size(); i++) {
-		if (content_[i].IsFlagSet(ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED)) {
-			ESCrypto::SetupContentAesIv(content_[i].GetContentIndex(), content_iv_);
-			Crypto::AesCbcEncrypt(content_[i].GetData(), content_[i].GetSize(), titlekey_, content_iv_, out.data() + pos);
-		}
-		else {
-			memcpy(out.data() + pos, content_[i].GetData(), content_[i].GetSize());
-		}
-
-
-		pos += content_[i].GetSize();
+	// content is processed in parallel, each at its own offset
+	std::vector<ESContent::sHashContext> hash_ctx(content_.size());
+	ThreadPool pool(GetContentThreadNum());
+	u8* content_out = out.data() + header_.GetContentOffset();
+	for (size_t i = 0; i < content_.size(); i++)
+	{
+		pool.submit([this, &hash_ctx, i, content_out]() { WriteContentToBuffer(content_out, i, hash_ctx[i]); });
+		content_out += content_[i].GetSize();
 	}
+	pool.wait();
+
+	// the tmd is copied once the content has been hashed
+	UpdateContentHashes(hash_ctx);
+	memcpy(out.data() + header_.GetTmdOffset(), tmd_.GetSerialisedData(), tmd_.GetSerialisedDataSize());
 }
 
 
+void CiaBuilder::SetThreadNum(size_t thread_num)
+{
+	thread_num_ = thread_num;
+}
+
 void CiaBuilder::SetCaCert(const u8 * cert)
 {
 	ca_cert_.DeserialiseCert(cert);
 }
 
+void CiaBuilder::SetCaCert(const ESCert & cert)
+{
+	ca_cert_ = cert;
+}
+
 void CiaBuilder::SetTicketSigner(const Crypto::sRsa2048Key & rsa_key, const u8 * cert)
 {
 	tik_sign_.cert.DeserialiseCert(cert);
 	tik_sign_.rsa_key = rsa_key;
 }
 
+void CiaBuilder::SetTicketSigner(const Crypto::sRsa2048Key & rsa_key, const ESCert & cert)
+{
+	tik_sign_.cert = cert;
+	tik_sign_.rsa_key = rsa_key;
+}
+
 void CiaBuilder::SetTmdSigner(const Crypto::sRsa2048Key & rsa_key, const u8 * cert)
 {
 	tmd_sign_.cert.DeserialiseCert(cert);
 	tmd_sign_.rsa_key = rsa_key;
 }
 
+void CiaBuilder::SetTmdSigner(const Crypto::sRsa2048Key & rsa_key, const ESCert & cert)
+{
+	tmd_sign_.cert = cert;
+	tmd_sign_.rsa_key = rsa_key;
+}
+
 void CiaBuilder::AddContent(u32 id, u16 index, u16 flags, const u8* data, u64 size)
 {
+	// hashed when the CIA is written
 	ESContent content = ESContent(ESContentInfo(id, index, flags, size, nullptr), data);
-	content.UpdateContentHash();
+
+	content_.push_back(content);
+}
+
+void CiaBuilder::AddContent(u32 id, u16 index, u16 flags, IoStream& stream, u64 offset, u64 size)
+{
+	// hashed when the CIA is written
+	ESContent content = ESContent(ESContentInfo(id, index, flags, size, nullptr), stream, offset);
 
 	content_.push_back(content);
 }
@@ -224,6 +510,7 @@ void CiaBuilder::AddContent(u32 id, u16 index, u16 flags, const u8* data, u64 si
 void CiaBuilder::SetTitleKey(const u8 * key)
 {
 	memcpy(titlekey_, key, Crypto::kAes128KeySize);
+	titlekey_schedule_.SetKey(titlekey_, AesKeySchedule::USAGE_ENCRYPT); // contents are only ever encrypted
 }
 
 void CiaBuilder::SetCommonKey(const u8 * key, u8 index)
@@ -3,7 +3,10 @@
 #include <vector>
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
+#include <fnd/output_file.h>
 #include <crypto/crypto.h>
+#include <crypto/aes_key_schedule.h>
 #include <ctr/cia_header.h>
 #include <ctr/cia_footer.h>
 #include <es/es_cert_chain.h>
@@ -19,12 +22,20 @@ public:
 
 	void CreateCia();
 	void WriteToFile(const std::string& path);
+	void WriteToFile(const std::string& path, OutputFile::SyncPolicy sync_policy);
 	void WriteToBuffer(MemoryBlob& out);
 
+	// threads used to process content, 0 for one per core, 1 keeps all the work on the calling thread
+	void SetThreadNum(size_t thread_num);
+
 	void SetCaCert(const u8* cert);
+	void SetCaCert(const ESCert& cert);
 	void SetTicketSigner(const Crypto::sRsa2048Key& rsa_key, const u8* cert);
+	void SetTicketSigner(const Crypto::sRsa2048Key& rsa_key, const ESCert& cert);
 	void SetTmdSigner(const Crypto::sRsa2048Key& rsa_key, const u8* cert);
+	void SetTmdSigner(const Crypto::sRsa2048Key& rsa_key, const ESCert& cert);
 	void AddContent(u32 id, u16 index, u16 flags, const u8* data, u64 size);
+	void AddContent(u32 id, u16 index, u16 flags, IoStream& stream, u64 offset, u64 size); // the stream must outlive the builder
 
 	void SetTitleKey(const u8* key);
 	void SetCommonKey(const u8* key, u8 index);
@@ -43,7 +54,18 @@ public:
 private:
 	const std::string kModuleName = "CIA_BUILDER";
 
-	static const int kIoBufferLen = 0x100000;
+	static const size_t kIoBufferLen = 0x100000;
+	static const size_t kPipelineDepth = 4; // content blocks in flight between pipeline stages
+
+	// block of content on its way through the write pipeline
+	struct sContentBlock
+	{
+		u64 offset;
+		size_t size;
+		const u8* data; // plaintext
+		const u8* out; // data as it appears in the CIA
+		std::vector<u8> buffer;
+	};
 
 	struct ESSigner {
 		ESCert cert;
@@ -70,18 +92,23 @@ private:
 
 	u32 launch_num_;
 
+	size_t thread_num_;
+
 	u8 titlekey_[Crypto::kAes128KeySize];
-	u8 content_iv_[Crypto::kAesBlockSize];
+	AesKeySchedule titlekey_schedule_; // expanded once, shared by every content worker
 
 	u8 commonkey_index_;
 	u8 commonkey_[Crypto::kAes128KeySize];
 
-	u8 io_buffer[kIoBufferLen];
-
 	void MakeCertificateChain();
 	void MakeTicket();
 	void MakeTmd();
+	void SignTmd();
 	void MakeHeader();
 
-	void WriteContentBlockToFile(const u8* data, size_t size, bool encrypted, FILE* fp);
+	size_t GetContentThreadNum() const;
+	void WriteContentToFile(OutputFile& file, size_t index, u64 file_offset, ESContent::sHashContext& hash_ctx);
+	void WriteContentToFileSerial(OutputFile& file, size_t index, u64 file_offset, ESContent::sHashContext& hash_ctx);
+	void WriteContentToBuffer(u8* out, size_t index, ESContent::sHashContext& hash_ctx);
+	void UpdateContentHashes(std::vector<ESContent::sHashContext>& hash_ctx);
 };
\ No newline at end of file
@@ -164,6 +164,13 @@ void CiaHeader::DeserialiseHeader(const u8* cia_data)
 	CalculateCiaSize();
 }
 
+void CiaHeader::DeserialiseHeader(IoStream& stream, u64 offset)
+{
+	u8 data[sizeof(sCiaHeader)];
+	stream.read(offset, sizeof(sCiaHeader), data);
+	DeserialiseHeader(data);
+}
+
 size_t CiaHeader::GetCertificateChainOffset() const
 {
 	return certs_.offset;
@@ -2,6 +2,7 @@
 #include <vector>
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
 
 class CiaHeader
 {
@@ -32,6 +33,7 @@ public:
 
 	// Header Deserialisation
 	void DeserialiseHeader(const u8* cia_data);
+	void DeserialiseHeader(IoStream& stream, u64 offset);
 	size_t GetCertificateChainOffset() const;
 	size_t GetCertificateChainSize() const;
 	size_t GetTicketOffset() const;
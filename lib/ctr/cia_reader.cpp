@@ -1,10 +1,19 @@
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <exception>
+#include <fnd/memory_stream.h>
+#include <fnd/bounded_queue.h>
+#include <fnd/thread_pool.h>
 #include "cia_reader.h"
 #include "ctr_program_id.h"
 #include "ctr_tmd_reserved_data.h"
 
 
 
-CiaReader::CiaReader()
+CiaReader::CiaReader() :
+	cia_stream_(nullptr),
+	loaded_sections_(0)
 {
 }
 
@@ -15,152 +24,379 @@ CiaReader::~CiaReader()
 
 void CiaReader::ImportCia(const u8 * cia_data)
 {
-	// get header
+	// the header tells us how large the image is
 	header_.DeserialiseHeader(cia_data);
+	MemoryStream cia_stream(cia_data, header_.GetPredictedCiaSize());
 
-	// check more sections? remove legacy support for older formats?
-	if (header_.GetContentSize() == 0)
-	{
-		throw ProjectSnakeException(kModuleName, "Cia has no content");
-	}
-
-	// get sections
-	if (header_.GetCertificateChainSize() > 0)
+	// everything is parsed here, the temporary stream must not be used afterwards
+	try
 	{
-		certs_.DeserialiseCertChain(cia_data + header_.GetCertificateChainOffset(), header_.GetCertificateChainSize());
+		ImportHeader(cia_stream);
+		ImportSections();
+		ImportContentList(cia_data + header_.GetContentOffset(), nullptr);
 	}
-
-	if (header_.GetTicketSize() > 0)
+	catch (...)
 	{
-		tik_.DeserialiseTicket(cia_data + header_.GetTicketOffset(), header_.GetTicketSize());
-	}
-
-	if (header_.GetTmdSize() > 0)
-	{
-		tmd_.DeserialiseTmd(cia_data + header_.GetTmdOffset(), header_.GetTmdSize());
-
-		DeserialiseTmdPlatformReservedData();
-	}
-
-	if (header_.GetFooterSize() > 0)
-	{
-		footer_.DeserialiseFooter(cia_data + header_.GetFooterOffset(), header_.GetFooterSize());
-	}
-
-	// corruption check
-	if (tmd_.GetTitleId() != tik_.GetTitleId())
-	{
-		throw ProjectSnakeException(kModuleName, "Cia is corrupt, ticket and tmd have mismatching title ids");
+		cia_stream_ = nullptr;
+		throw;
 	}
+	cia_stream_ = nullptr;
+}
 
-	// save info about
-	size_t content_pos = 0;
-	for (const auto& tmd_content : tmd_.GetContentList())
-	{
-		ESContent content = ESContent(tmd_content, cia_data + header_.GetContentOffset() + content_pos);
-		
-		// enable content
-		content.EnableContent(tik_.IsContentEnabled(content.GetContentIndex()));
-		
-		// note related data
-		if (header_.IsContentEnabled(content.GetContentIndex()) != tik_.IsContentEnabled(content.GetContentIndex()))
-		{
-			throw ProjectSnakeException(kModuleName, "Cia content enabled inconsistient between ticket and cia header");
-		}
-		// add to list
-		content_list_.push_back(content);
+void CiaReader::ImportCia(IoStream& cia_stream)
+{
+	ImportHeader(cia_stream);
+	ImportSections();
+	ImportContentList(nullptr, &cia_stream);
+}
 
-		// increment pos
-		content_pos += align(content.GetSize(), 0x10);
-	}
+void CiaReader::ImportCiaMetadata(IoStream& cia_stream)
+{
+	ImportHeader(cia_stream);
 }
 
 u64 CiaReader::GetTitleId() const
 {
+	LoadTmd();
 	return tmd_.GetTitleId();
 }
 
 u16 CiaReader::GetTitleVersion() const
 {
+	LoadTmd();
 	return tmd_.GetTitleVersion();
 }
 
 u8 CiaReader::GetCommonKeyIndex() const
 {
+	LoadTicket();
 	return tik_.GetCommonKeyIndex();
 }
 
 u32 CiaReader::GetCtrSaveSize() const
 {
+	LoadTmd();
 	return ctr_save_size_;
 }
 
 u32 CiaReader::GetTwlPublicSaveSize() const
 {
+	LoadTmd();
 	return twl_public_save_size_;
 }
 
 u32 CiaReader::GetTwlPrivateSaveSize() const
 {
+	LoadTmd();
 	return twl_private_save_size_;
 }
 
 u8 CiaReader::GetSrlFlag() const
 {
+	LoadTmd();
 	return srl_flag_;
 }
 
 const u8 * CiaReader::GetTitleKey(const u8 * common_key)
 {
+	LoadTicket();
 	return tik_.GetTitleKey(common_key);
 }
 
 const ESCertChain & CiaReader::GetCertificateChain() const
 {
+	LoadCertificates();
 	return certs_;
 }
 
 const ESTicket & CiaReader::GetTicket() const
 {
+	LoadTicket();
 	return tik_;
 }
 
 const ESTmd & CiaReader::GetTmd() const
 {
+	LoadTmd();
 	return tmd_;
 }
 
 const CiaFooter & CiaReader::GetFooter() const
 {
+	LoadFooter();
 	return footer_;
 }
 
 std::vector<ESContent>& CiaReader::GetContentList()
 {
+	if ((loaded_sections_ & SECTION_CONTENT) == 0)
+	{
+		ImportContentList(nullptr, cia_stream_);
+	}
 	return content_list_;
 }
 
 bool CiaReader::ValidateCertificates(const Crypto::sRsa4096Key & root_key) const
 {
+	LoadCertificates();
 	return certs_.ValidateChain(root_key);
 }
 
 bool CiaReader::ValidateCertificatesExceptCa() const
 {
+	LoadCertificates();
 	return certs_.ValidateChainExceptCa();
 }
 
 bool CiaReader::ValidateTicket() const
 {
+	LoadCertificates();
+	LoadTicket();
 	return tik_.ValidateSignature(certs_[tik_.GetIssuer()]);
 }
 
 bool CiaReader::ValidateTmd() const
 {
+	LoadCertificates();
+	LoadTmd();
 	return tmd_.ValidateSignature(certs_[tmd_.GetIssuer()]);
 }
 
-void CiaReader::DeserialiseTmdPlatformReservedData()
+bool CiaReader::ValidateContents(const u8* common_key)
+{
+	sContentValidationReport report;
+	return ValidateContents(common_key, report);
+}
+
+bool CiaReader::ValidateContents(const u8* common_key, sContentValidationReport& report)
+{
+	AesKeySchedule key(GetTitleKey(common_key));
+	std::vector<ESContent>& content_list = GetContentList();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// every content has its own iv and hash, so each is checked independently
+	ThreadPool pool(content_list.size() < ThreadPool::default_thread_num() ? content_list.size() : ThreadPool::default_thread_num());
+	report.contents.resize(content_list.size());
+	report.thread_num = pool.thread_num();
+	report.total_size = 0;
+	for (size_t i = 0; i < content_list.size(); i++)
+	{
+		sContentValidation& result = report.contents[i];
+		result.content_id = content_list[i].GetContentId();
+		result.content_index = content_list[i].GetContentIndex();
+		result.size = content_list[i].GetSize();
+		result.is_valid = false;
+		result.seconds = 0;
+		report.total_size += result.size;
+
+		pool.submit([this, &content_list, &key, &result, i]()
+		{
+			std::chrono::steady_clock::time_point content_start = std::chrono::steady_clock::now();
+			try
+			{
+				result.is_valid = ValidateContent(content_list[i], key);
+			}
+			catch (const ProjectSnakeException&)
+			{
+				// a content that can't be read fails on its own, the others are still checked
+				result.is_valid = false;
+			}
+			result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - content_start).count();
+		});
+	}
+	pool.wait();
+
+	report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return report.is_valid();
+}
+
+bool CiaReader::sContentValidationReport::is_valid() const
+{
+	for (const auto& content : contents)
+	{
+		if (content.is_valid == false)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+double CiaReader::sContentValidationReport::bytes_per_second() const
+{
+	return seconds > 0 ? (double)total_size / seconds : 0;
+}
+
+void CiaReader::ImportHeader(IoStream& cia_stream)
+{
+	cia_stream_ = &cia_stream;
+	loaded_sections_ = 0;
+
+	// get header
+	header_.DeserialiseHeader(cia_stream, 0);
+
+	// check more sections? remove legacy support for older formats?
+	if (header_.GetContentSize() == 0)
+	{
+		throw ProjectSnakeException(kModuleName, "Cia has no content");
+	}
+}
+
+void CiaReader::ImportSections()
+{
+	LoadCertificates();
+	LoadTicket();
+	LoadTmd();
+	LoadFooter();
+}
+
+void CiaReader::LoadCertificates() const
+{
+	std::lock_guard<std::mutex> lock(section_mutex_);
+	if ((loaded_sections_ & SECTION_CERTS) != 0)
+	{
+		return;
+	}
+
+	if (header_.GetCertificateChainSize() > 0)
+	{
+		MemoryBlob section;
+		ReadSection(header_.GetCertificateChainOffset(), header_.GetCertificateChainSize(), section);
+		certs_.DeserialiseCertChain(section.data(), header_.GetCertificateChainSize());
+	}
+	loaded_sections_ |= SECTION_CERTS;
+}
+
+void CiaReader::LoadTicket() const
+{
+	std::lock_guard<std::mutex> lock(section_mutex_);
+	if ((loaded_sections_ & SECTION_TICKET) != 0)
+	{
+		return;
+	}
+
+	if (header_.GetTicketSize() > 0)
+	{
+		MemoryBlob section;
+		ReadSection(header_.GetTicketOffset(), header_.GetTicketSize(), section);
+		tik_.DeserialiseTicket(section.data(), header_.GetTicketSize());
+	}
+	// only marked as loaded once the check passes, so a corrupt section is never returned
+	CheckTitleIds(loaded_sections_ | SECTION_TICKET);
+	loaded_sections_ |= SECTION_TICKET;
+}
+
+void CiaReader::LoadTmd() const
+{
+	std::lock_guard<std::mutex> lock(section_mutex_);
+	if ((loaded_sections_ & SECTION_TMD) != 0)
+	{
+		return;
+	}
+
+	if (header_.GetTmdSize() > 0)
+	{
+		MemoryBlob section;
+		ReadSection(header_.GetTmdOffset(), header_.GetTmdSize(), section);
+		tmd_.DeserialiseTmd(section.data(), header_.GetTmdSize());
+
+		DeserialiseTmdPlatformReservedData();
+	}
+	// only marked as loaded once the check passes, so a corrupt section is never returned
+	CheckTitleIds(loaded_sections_ | SECTION_TMD);
+	loaded_sections_ |= SECTION_TMD;
+}
+
+void CiaReader::LoadFooter() const
+{
+	std::lock_guard<std::mutex> lock(section_mutex_);
+	if ((loaded_sections_ & SECTION_FOOTER) != 0)
+	{
+		return;
+	}
+
+	if (header_.GetFooterSize() > 0)
+	{
+		MemoryBlob section;
+		ReadSection(header_.GetFooterOffset(), header_.GetFooterSize(), section);
+		footer_.DeserialiseFooter(section.data(), header_.GetFooterSize());
+	}
+	loaded_sections_ |= SECTION_FOOTER;
+}
+
+void CiaReader::CheckTitleIds(u32 sections) const
+{
+	// corruption check, made once both sections are in
+	if ((sections & (SECTION_TICKET | SECTION_TMD)) != (SECTION_TICKET | SECTION_TMD))
+	{
+		return;
+	}
+
+	if (tmd_.GetTitleId() != tik_.GetTitleId())
+	{
+		throw ProjectSnakeException(kModuleName, "Cia is corrupt, ticket and tmd have mismatching title ids");
+	}
+}
+
+void CiaReader::ImportContentList(const u8* content_data, IoStream* content_stream)
+{
+	LoadTicket();
+	LoadTmd();
+	content_list_.clear();
+
+	// contents from a stream are read on demand, so the sizes the tmd claims are checked against the cia first
+	if (content_stream != nullptr && content_stream->size() < (u64)header_.GetContentOffset() + header_.GetContentSize())
+	{
+		throw ProjectSnakeException(kModuleName, "Cia is corrupt, content section is beyond end of file");
+	}
+
+	// save info about
+	size_t content_pos = 0;
+	for (const auto& tmd_content : tmd_.GetContentList())
+	{
+		if (content_pos > header_.GetContentSize() || tmd_content.GetSize() > header_.GetContentSize() - content_pos)
+		{
+			throw ProjectSnakeException(kModuleName, "Cia is corrupt, tmd content is beyond end of content section");
+		}
+
+		ESContent content = content_stream != nullptr ? 
+			ESContent(tmd_content, *content_stream, header_.GetContentOffset() + content_pos) :
+			ESContent(tmd_content, content_data + content_pos);
+		
+		// enable content
+		content.EnableContent(tik_.IsContentEnabled(content.GetContentIndex()));
+		
+		// note related data
+		if (header_.IsContentEnabled(content.GetContentIndex()) != tik_.IsContentEnabled(content.GetContentIndex()))
+		{
+			throw ProjectSnakeException(kModuleName, "Cia content enabled inconsistient between ticket and cia header");
+		}
+		// add to list
+		content_list_.push_back(content);
+
+		// increment pos
+		content_pos += align(content.GetSize(), 0x10);
+	}
+	loaded_sections_ |= SECTION_CONTENT;
+}
+
+void CiaReader::ReadSection(u64 offset, size_t size, MemoryBlob& section) const
+{
+	if (cia_stream_ == nullptr)
+	{
+		throw ProjectSnakeException(kModuleName, "No cia has been imported");
+	}
+
+	if (section.alloc(size) != section.ERR_NONE)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to allocate memory for cia section");
+	}
+	cia_stream_->read(offset, size, section.data());
+}
+
+void CiaReader::DeserialiseTmdPlatformReservedData() const
 {
 	// deserialise platform reserved region
 	const sCtrTmdPlatormReservedRegion* tmd_data = (const sCtrTmdPlatormReservedRegion*)tmd_.GetPlatformReservedData();
@@ -185,3 +421,163 @@ void CiaReader::DeserialiseTmdPlatformReservedData()
 		srl_flag_ = 0;
 	}
 }
+
+bool CiaReader::ValidateContent(const ESContent& content, const AesKeySchedule& key) const
+{
+	bool is_content_encrypted = content.IsFlagSet(ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED);
+	if (is_content_encrypted && content.GetSize() % Crypto::kAesBlockSize != 0)
+	{
+		return false;
+	}
+
+	// the iv is carried between blocks by the cbc function
+	u8 iv[Crypto::kAesBlockSize];
+	content.SetupAesIV(iv);
+
+	ESContent::sHashContext hash_ctx;
+	hash_ctx.init(content.IsSha1Hash());
+
+	// stream backed content is read into the block, in memory content is referenced in place
+	auto read_block = [&content](sContentBlock& block)
+	{
+		if (content.IsStreamBacked())
+		{
+			content.ReadData(block.offset, block.size, block.buffer.data());
+			block.data = block.buffer.data();
+		}
+		else
+		{
+			block.data = content.GetData() + block.offset;
+		}
+	};
+	auto decrypt_block = [&](sContentBlock& block)
+	{
+		if (is_content_encrypted && block.size > 0)
+		{
+			Crypto::AesCbcDecrypt(block.data, block.size, key, iv, block.buffer.data());
+			block.data = block.buffer.data();
+		}
+	};
+
+	// a single block isn't worth the threads
+	if (content.GetSize() <= kIoBufferLen)
+	{
+		sContentBlock block;
+		block.offset = 0;
+		block.size = (size_t)content.GetSize();
+		block.buffer.resize(block.size);
+		read_block(block);
+		decrypt_block(block);
+		hash_ctx.update(block.data, block.size);
+	}
+	// read -> decrypt -> hash, each stage on its own thread
+	// blocks cycle back to the free queue once hashed, bounding the data in flight
+	else
+	{
+		std::vector<sContentBlock> blocks(kPipelineDepth);
+		BoundedQueue<sContentBlock*> free_queue(kPipelineDepth);
+		BoundedQueue<sContentBlock*> crypt_queue(kPipelineDepth);
+		BoundedQueue<sContentBlock*> hash_queue(kPipelineDepth);
+		for (auto& block : blocks)
+		{
+			block.buffer.resize(kIoBufferLen);
+			free_queue.push(&block);
+		}
+
+		// the first error stops every stage
+		std::mutex error_mutex;
+		std::exception_ptr error;
+		auto fail = [&](std::exception_ptr e)
+		{
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if (error == nullptr)
+			{
+				error = e;
+			}
+			free_queue.close();
+			crypt_queue.close();
+			hash_queue.close();
+		};
+
+		std::thread crypter([&]()
+		{
+			try
+			{
+				sContentBlock* block;
+				while (crypt_queue.pop(block))
+				{
+					decrypt_block(*block);
+					if (hash_queue.push(block) == false)
+					{
+						break;
+					}
+				}
+				hash_queue.close();
+			}
+			catch (...)
+			{
+				fail(std::current_exception());
+			}
+		});
+
+		std::thread hasher([&]()
+		{
+			try
+			{
+				sContentBlock* block;
+				while (hash_queue.pop(block))
+				{
+					hash_ctx.update(block->data, block->size);
+					if (free_queue.push(block) == false)
+					{
+						break;
+					}
+				}
+			}
+			catch (...)
+			{
+				fail(std::current_exception());
+			}
+		});
+
+		// read stage
+		try
+		{
+			for (u64 pos = 0; pos < content.GetSize(); pos += kIoBufferLen)
+			{
+				sContentBlock* block;
+				if (free_queue.pop(block) == false)
+				{
+					break;
+				}
+
+				block->offset = pos;
+				block->size = (content.GetSize() - pos) < kIoBufferLen ? (size_t)(content.GetSize() - pos) : kIoBufferLen;
+				read_block(*block);
+
+				if (crypt_queue.push(block) == false)
+				{
+					break;
+				}
+			}
+			crypt_queue.close();
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+		}
+
+		crypter.join();
+		hasher.join();
+
+		if (error != nullptr)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+	u8 hash[Crypto::kSha256HashLen];
+	hash_ctx.final(hash);
+
+	return content.ValidateHash(hash);
+}
@@ -1,7 +1,10 @@
 #pragma once
+#include <mutex>
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
 #include <crypto/crypto.h>
+#include <crypto/aes_key_schedule.h>
 #include <ctr/cia_header.h>
 #include <ctr/cia_footer.h>
 #include <es/es_crypto.h>
@@ -10,14 +13,42 @@
 #include <es/es_ticket.h>
 #include <es/es_tmd.h>
 
-
+/*
+ Sections are parsed the first time they are needed. Once a cia is
+ imported, the const accessors may be called from several threads, section
+ loading is serialised by a lock. Importing, GetTitleKey and GetContentList
+ are not thread safe.
+*/
 class CiaReader
 {
 public:
+	// outcome of checking one content against its tmd hash
+	struct sContentValidation
+	{
+		u32 content_id;
+		u16 content_index;
+		u64 size;
+		bool is_valid;
+		double seconds;
+	};
+
+	struct sContentValidationReport
+	{
+		std::vector<sContentValidation> contents;
+		size_t thread_num;
+		u64 total_size;
+		double seconds;
+
+		bool is_valid() const;
+		double bytes_per_second() const;
+	};
+
 	CiaReader();
 	~CiaReader();
 
 	void ImportCia(const u8* cia_data);
+	void ImportCia(IoStream& cia_stream); // content is read from the stream on demand, the stream must outlive the reader
+	void ImportCiaMetadata(IoStream& cia_stream); // only the header is read now, sections are read when first needed and content is never touched
 	
 	// common interaction
 	u64 GetTitleId() const;
@@ -43,23 +74,61 @@ public:
 	bool ValidateCertificatesExceptCa() const; // same as above, except certifcates with "Root" as parent aren't checked
 	bool ValidateTicket() const; // verifies the ticket with the corresponding cert in the cert chain
 	bool ValidateTmd() const; // verifies the tmd with the corresponding cert in the cert chain
+	bool ValidateContents(const u8* common_key); // decrypts and hashes every content, each on its own worker. contents must still be as stored in the cia
+	bool ValidateContents(const u8* common_key, sContentValidationReport& report);
 
 private:
 	const std::string kModuleName = "CIA_READER";
 
+	static const size_t kIoBufferLen = 0x100000;
+	static const size_t kPipelineDepth = 4; // content blocks in flight between pipeline stages
+
+	// block of content on its way through the validation pipeline
+	struct sContentBlock
+	{
+		u64 offset;
+		size_t size;
+		const u8* data; // as stored in the cia, then plaintext once decrypted
+		std::vector<u8> buffer;
+	};
+
+	enum SectionFlag
+	{
+		SECTION_CERTS = BIT(0),
+		SECTION_TICKET = BIT(1),
+		SECTION_TMD = BIT(2),
+		SECTION_FOOTER = BIT(3),
+		SECTION_CONTENT = BIT(4),
+	};
+
+	// sections are parsed on first use, so the const accessors may still fill them in
+	IoStream* cia_stream_;
+	mutable std::mutex section_mutex_; // guards loaded_sections_ and the lazily loaded sections
+	mutable u32 loaded_sections_;
+
 	CiaHeader header_;
-	ESCertChain certs_;
-	ESTicket tik_;
-	ESTmd tmd_;
+	mutable ESCertChain certs_;
+	mutable ESTicket tik_;
+	mutable ESTmd tmd_;
 	std::vector<ESContent> content_list_;
-	CiaFooter footer_;
+	mutable CiaFooter footer_;
 
 	// tmd platform reserved data
-	u32 ctr_save_size_;
-	u32 twl_public_save_size_;
-	u32 twl_private_save_size_;
-	u8 srl_flag_;
+	mutable u32 ctr_save_size_;
+	mutable u32 twl_public_save_size_;
+	mutable u32 twl_private_save_size_;
+	mutable u8 srl_flag_;
 
-	void DeserialiseTmdPlatformReservedData();
+	void ImportHeader(IoStream& cia_stream);
+	void ImportSections();
+	void LoadCertificates() const;
+	void LoadTicket() const;
+	void LoadTmd() const;
+	void LoadFooter() const;
+	void CheckTitleIds(u32 sections) const; // sections holds the flags of the sections that are loaded
+	void ReadSection(u64 offset, size_t size, MemoryBlob& section) const;
+	void ImportContentList(const u8* content_data, IoStream* content_stream);
+	void DeserialiseTmdPlatformReservedData() const;
+	bool ValidateContent(const ESContent& content, const AesKeySchedule& key) const;
 };
 
@@ -56,7 +56,7 @@ void ExefsHeader::SerialiseData()
 	for (size_t i = 0; i < files_.size() && i < kExefsFileNum; i++)
 	{
 		files_[i].offset = pos;
-		pos += align(pos + files_[i].size, align_size_);
+		pos = align(pos + files_[i].size, align_size_);
 
 		hdr->set_name(i, files_[i].name.c_str());
 		hdr->set_offset(i, files_[i].offset);
@@ -80,7 +80,7 @@ void ExefsHeader::AddExefsFile(const std::string & name, u32 size, u8 hash[Crypt
 	{
 		throw ProjectSnakeException(kModuleName, "Exefs file name too long. (max 8 characters)");
 	}
-	if (files_.size() > kExefsFileNum)
+	if (files_.size() >= kExefsFileNum)
 	{
 		throw ProjectSnakeException(kModuleName, "Too many exefs files. (max 8 files)");
 	}
@@ -90,6 +90,7 @@ void ExefsHeader::AddExefsFile(const std::string & name, u32 size, u8 hash[Crypt
 	file.offset = 0;
 	file.size = size;
 	memcpy(file.hash, hash, Crypto::kSha256HashLen);
+	files_.push_back(file);
 }
 
 void ExefsHeader::DeserialiseData(const u8 * data)
@@ -119,7 +120,7 @@ void ExefsHeader::DeserialiseData(const u8 * data)
 			latest_file_ = i;
 		}
 
-		file.name = std::string(hdr->name(i), kExefsFileNameLength);
+		file.name = std::string(hdr->name(i), strnlen(hdr->name(i), kExefsFileNameLength)); // names are nul padded, not terminated
 		file.offset = hdr->offset(i);
 		file.size = hdr->size(i);
 		memcpy(file.hash, hdr->hash(i), Crypto::kSha256HashLen);
@@ -129,6 +130,13 @@ void ExefsHeader::DeserialiseData(const u8 * data)
 	exefs_size_ = align(hdr->offset(latest_file_) + hdr->size(latest_file_), align_size_);
 }
 
+void ExefsHeader::DeserialiseData(IoStream& stream, u64 offset)
+{
+	u8 data[sizeof(sExefsHeader)];
+	stream.read(offset, sizeof(sExefsHeader), data);
+	DeserialiseData(data);
+}
+
 size_t ExefsHeader::GetExefsSize() const
 {
 	return exefs_size_;
@@ -2,6 +2,7 @@
 #include <vector>
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
 #include <crypto/crypto.h>
 
 
@@ -41,6 +42,7 @@ public:
 
 	// Data Deserialisation
 	void DeserialiseData(const u8* data);
+	void DeserialiseData(IoStream& stream, u64 offset);
 	size_t GetExefsSize() const;
 	const std::vector<sExefsFile>& GetExefsFiles() const;
 
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <vector>
+#include <crypto/crypto.h>
+#include <fnd/thread_pool.h>
+#include "ivfc_builder.h"
+
+IvfcBuilder::IvfcBuilder()
+{
+}
+
+IvfcBuilder::~IvfcBuilder()
+{
+}
+
+void IvfcBuilder::BuildTree(IoStream& level_2_stream, u64 offset, u64 size, IvfcHeader::IvfcType type)
+{
+	InitialiseTree(size, type);
+	HashLevel2(level_2_stream, offset, size, nullptr);
+}
+
+void IvfcBuilder::BuildImage(IoStream& level_2_stream, u64 offset, u64 size, IvfcHeader::IvfcType type, OutputFile& image)
+{
+	InitialiseTree(size, type);
+
+	// level 2 is written as it is hashed, the header and master hash are filled in once they are known
+	u64 image_start = image.tell();
+	image.skip(header_.GetLevelDataOffset(2));
+	HashLevel2(level_2_stream, offset, size, &image);
+
+	for (size_t i = 0; i < IvfcHeader::kLevelNum - 1; i++)
+	{
+		u64 pos = image.tell() - image_start;
+		image.pad((size_t)(header_.GetLevelDataOffset(i) - pos));
+		image.write(level_[i].data(), (size_t)header_.GetLevelSize(i));
+	}
+
+	MemoryBlob image_header;
+	SerialiseImageHeader(image_header);
+	image.write_at(image_start, image_header.data(), image_header.size());
+}
+
+void IvfcBuilder::ImportTree(IoStream& image_stream, u64 offset)
+{
+	// block sizes are bounded by the header, the sizes are checked before anything is allocated from them
+	header_.DeserialiseData(image_stream, offset);
+	for (size_t i = 0; i < IvfcHeader::kLevelNum; i++)
+	{
+		u64 block_num = align(header_.GetLevelSize(i), header_.GetLevelBlockSize(i)) / header_.GetLevelBlockSize(i);
+		u64 hash_size = i == 0 ? header_.GetMasterHashSize() : header_.GetLevelSize(i - 1);
+		if (hash_size % Crypto::kSha256HashLen != 0 || block_num != hash_size / Crypto::kSha256HashLen)
+		{
+			throw ProjectSnakeException(kModuleName, "IVFC header is corrupt (hash level size mismatch)");
+		}
+	}
+
+	// the whole image must be within the stream, checked in layout order so no level offset can wrap
+	u64 image_size = image_stream.size() > offset ? image_stream.size() - offset : 0;
+	if (header_.GetMasterHashOffset() > image_size || header_.GetMasterHashSize() > image_size - header_.GetMasterHashOffset())
+	{
+		throw ProjectSnakeException(kModuleName, "IVFC image is truncated");
+	}
+	for (size_t i : { IvfcHeader::kLevelNum - 1, (size_t)0, (size_t)1 })
+	{
+		if (header_.GetLevelDataOffset(i) > image_size || header_.GetLevelSize(i) > image_size - header_.GetLevelDataOffset(i))
+		{
+			throw ProjectSnakeException(kModuleName, "IVFC image is truncated");
+		}
+	}
+	AllocateLevels();
+
+	image_stream.read(offset + header_.GetMasterHashOffset(), master_hash_.size(), master_hash_.data());
+	for (size_t i = 0; i < IvfcHeader::kLevelNum - 1; i++)
+	{
+		image_stream.read(offset + header_.GetLevelDataOffset(i), (size_t)header_.GetLevelSize(i), level_[i].data());
+	}
+}
+
+void IvfcBuilder::UpdateTree(IoStream& level_2_stream, u64 offset, const std::vector<sRange>& modified_ranges)
+{
+	if (master_hash_.size() == 0)
+	{
+		throw ProjectSnakeException(kModuleName, "No IVFC tree to update");
+	}
+
+	// the touched blocks, sorted and merged so no block is hashed twice
+	u64 block_size = header_.GetLevelBlockSize(2);
+	u64 level_2_size = header_.GetLevelSize(2);
+	std::vector<std::pair<u64, u64>> block_ranges;
+	for (const auto& range : modified_ranges)
+	{
+		if (range.offset > level_2_size || range.size > level_2_size - range.offset)
+		{
+			throw ProjectSnakeException(kModuleName, "Modified range is beyond end of IVFC level 2");
+		}
+		if (range.size > 0)
+		{
+			block_ranges.push_back(std::make_pair(range.offset / block_size, align(range.offset + range.size, block_size) / block_size));
+		}
+	}
+	std::sort(block_ranges.begin(), block_ranges.end());
+
+	std::vector<std::pair<u64, u64>> merged_ranges;
+	for (const auto& range : block_ranges)
+	{
+		if (merged_ranges.empty() == false && range.first <= merged_ranges.back().second)
+		{
+			merged_ranges.back().second = std::max(merged_ranges.back().second, range.second);
+		}
+		else
+		{
+			merged_ranges.push_back(range);
+		}
+	}
+
+	// each job writes only its own entries of level 1, so the jobs can run concurrently
+	u64 batch_block_num = block_size < kUpdateBatchLen ? kUpdateBatchLen / block_size : 1;
+	std::vector<u64> dirty_blocks;
+	ThreadPool pool;
+	for (const auto& range : merged_ranges)
+	{
+		for (u64 first = range.first; first < range.second; first += batch_block_num)
+		{
+			u64 num = std::min<u64>(batch_block_num, range.second - first);
+			for (u64 i = first; i < first + num; i++)
+			{
+				dirty_blocks.push_back(i);
+			}
+
+			pool.submit([this, &level_2_stream, offset, block_size, level_2_size, first, num]()
+			{
+				// the last block of level 2 is hashed as if padded with zeros
+				std::vector<u8> blocks((size_t)(num * block_size), 0);
+				u64 start = first * block_size;
+				level_2_stream.read(offset + start, (size_t)std::min<u64>(blocks.size(), level_2_size - start), blocks.data());
+				Crypto::Sha256BatchSerial(blocks.data(), (size_t)num, (size_t)block_size, level_[1].data() + first * Crypto::kSha256HashLen);
+			});
+		}
+	}
+	pool.wait();
+
+	// then only the hash blocks holding changed hashes, up to the master hash
+	std::vector<u64> dirty_level_1_blocks;
+	std::vector<u64> dirty_level_0_blocks;
+	UpdateLevel(1, dirty_blocks, dirty_level_1_blocks);
+	UpdateLevel(0, dirty_level_1_blocks, dirty_level_0_blocks);
+}
+
+const IvfcHeader& IvfcBuilder::GetHeader() const
+{
+	return header_;
+}
+
+const u8* IvfcBuilder::GetMasterHash() const
+{
+	return master_hash_.data();
+}
+
+size_t IvfcBuilder::GetMasterHashSize() const
+{
+	return master_hash_.size();
+}
+
+const u8* IvfcBuilder::GetLevelData(size_t index) const
+{
+	if (index >= IvfcHeader::kLevelNum - 1)
+	{
+		throw ProjectSnakeException(kModuleName, "Illegal IVFC hash level");
+	}
+
+	return level_[index].data();
+}
+
+u64 IvfcBuilder::GetImageSize() const
+{
+	// the last hash level ends the image
+	return header_.GetLevelDataOffset(IvfcHeader::kLevelNum - 2) + header_.GetLevelSize(IvfcHeader::kLevelNum - 2);
+}
+
+void IvfcBuilder::SerialiseImageHeader(MemoryBlob& data) const
+{
+	if (data.alloc((size_t)header_.GetLevelDataOffset(2)) != data.ERR_NONE)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to allocate memory for IVFC image header");
+	}
+
+	memcpy(data.data(), header_.GetSerialisedData(), header_.GetSerialisedDataSize());
+	memcpy(data.data() + header_.GetMasterHashOffset(), master_hash_.data(), master_hash_.size());
+}
+
+void IvfcBuilder::HashImageHeader(u64 hashed_size, u8 hash[Crypto::kSha256HashLen]) const
+{
+	MemoryBlob image_header;
+	SerialiseImageHeader(image_header);
+	if (hashed_size > image_header.size())
+	{
+		throw ProjectSnakeException(kModuleName, "Hashed region is larger than the IVFC image header");
+	}
+
+	Crypto::Sha256(image_header.data(), hashed_size, hash);
+}
+
+void IvfcBuilder::InitialiseTree(u64 size, IvfcHeader::IvfcType type)
+{
+	header_.SerialiseData(size, type);
+	AllocateLevels();
+}
+
+void IvfcBuilder::AllocateLevels()
+{
+	// hash levels are held padded, so they can be hashed as whole blocks
+	for (size_t i = 0; i < IvfcHeader::kLevelNum - 1; i++)
+	{
+		if (level_[i].alloc((size_t)header_.GetLevelAlignedSize(i)) != level_[i].ERR_NONE)
+		{
+			throw ProjectSnakeException(kModuleName, "Failed to allocate memory for IVFC hash level");
+		}
+	}
+	if (master_hash_.alloc(header_.GetMasterHashSize()) != master_hash_.ERR_NONE)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to allocate memory for IVFC master hash");
+	}
+}
+
+void IvfcBuilder::HashLevel2(IoStream& level_2_stream, u64 offset, u64 size, OutputFile* image)
+{
+	u64 block_size = header_.GetLevelBlockSize(2);
+	size_t buffer_len = (size_t)(kIoBufferLen - (kIoBufferLen % block_size));
+	if (buffer_len == 0)
+	{
+		buffer_len = (size_t)block_size;
+	}
+
+	// double buffered, the next block of level 2 is read on a dedicated reader thread while this one is hashed across the pool
+	// the buffers are declared first so the pools are joined before they are freed
+	std::vector<u8> buffer[2] = { std::vector<u8>(buffer_len), std::vector<u8>(buffer_len) };
+	ThreadPool reader(1);
+	ThreadPool hashers;
+	size_t buffer_index = 0;
+	u64 pos = 0;
+	size_t read_size = (size_t)(size < buffer_len ? size : buffer_len);
+	if (read_size > 0)
+	{
+		level_2_stream.read(offset, read_size, buffer[0].data());
+	}
+
+	while (read_size > 0)
+	{
+		std::vector<u8>& current = buffer[buffer_index];
+		std::vector<u8>& next = buffer[buffer_index ^ 1];
+
+		u64 next_pos = pos + read_size;
+		size_t next_size = (size_t)(size - next_pos < buffer_len ? size - next_pos : buffer_len);
+		if (next_size > 0)
+		{
+			reader.submit([&level_2_stream, &next, offset, next_pos, next_size]()
+			{
+				level_2_stream.read(offset + next_pos, next_size, next.data());
+			});
+		}
+
+		// the last block of level 2 is hashed as if padded with zeros
+		size_t block_num = (size_t)(align(read_size, block_size) / block_size);
+		memset(current.data() + read_size, 0, block_num * (size_t)block_size - read_size);
+		size_t job_block_num = (block_num + hashers.thread_num() - 1) / hashers.thread_num();
+		for (size_t first = 0; first < block_num; first += job_block_num)
+		{
+			size_t num = std::min<size_t>(job_block_num, block_num - first);
+			u8* hashes = level_[1].data() + (pos / block_size + first) * Crypto::kSha256HashLen;
+			const u8* data = current.data() + first * (size_t)block_size;
+			hashers.submit([data, num, block_size, hashes]()
+			{
+				Crypto::Sha256BatchSerial(data, num, (size_t)block_size, hashes);
+			});
+		}
+		hashers.wait();
+
+		if (image != nullptr)
+		{
+			image->write(current.data(), read_size);
+		}
+
+		reader.wait();
+		pos = next_pos;
+		read_size = next_size;
+		buffer_index ^= 1;
+	}
+
+	// the upper levels are small enough to hash from memory
+	HashLevel(level_[1], 1, level_[0].data());
+	HashLevel(level_[0], 0, master_hash_.data());
+}
+
+void IvfcBuilder::HashLevel(const MemoryBlob& level, size_t index, u8* hashes)
+{
+	u64 block_size = header_.GetLevelBlockSize(index);
+	Crypto::Sha256Batch(level.data(), (size_t)(level.size() / block_size), (size_t)block_size, hashes);
+}
+
+void IvfcBuilder::UpdateLevel(size_t index, const std::vector<u64>& dirty_hashes, std::vector<u64>& dirty_blocks)
+{
+	// dirty_hashes are the sorted indexes of the changed hashes in this level, the blocks holding them are re-hashed into the parent
+	u64 block_size = header_.GetLevelBlockSize(index);
+	u64 hash_num = block_size / Crypto::kSha256HashLen;
+	u8* parent = index == 0 ? master_hash_.data() : level_[index - 1].data();
+
+	dirty_blocks.clear();
+	for (u64 hash_index : dirty_hashes)
+	{
+		u64 block = hash_index / hash_num;
+		if (dirty_blocks.empty() || dirty_blocks.back() != block)
+		{
+			dirty_blocks.push_back(block);
+			Crypto::Sha256(level_[index].data() + block * block_size, block_size, parent + block * Crypto::kSha256HashLen);
+		}
+	}
+}
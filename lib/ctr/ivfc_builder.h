@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <fnd/types.h>
+#include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
+#include <fnd/output_file.h>
+#include <ctr/ivfc_header.h>
+
+/*
+ Builds an IVFC hash tree over level 2 data read from a stream.
+ Level 2 is read once in large blocks by a reader thread, the next block
+ being read while the current one is hashed across a pool sized to the
+ machine. Only the hash levels are kept in memory, level 2 stays in the
+ caller's stream.
+ An existing tree can be imported and patched after level 2 is modified,
+ only the blocks covering the modified ranges are read and re-hashed.
+*/
+class IvfcBuilder
+{
+public:
+	struct sRange
+	{
+		u64 offset;
+		u64 size;
+	};
+
+	IvfcBuilder();
+	~IvfcBuilder();
+
+	// level 2 is [offset, offset + size) of the stream
+	void BuildTree(IoStream& level_2_stream, u64 offset, u64 size, IvfcHeader::IvfcType type);
+
+	// as BuildTree(), and writes the whole IVFC image to the file at its current position in the same pass over level 2
+	void BuildImage(IoStream& level_2_stream, u64 offset, u64 size, IvfcHeader::IvfcType type, OutputFile& image);
+
+	// loads the header and hash levels of an existing image, offset is where the image starts in the stream
+	void ImportTree(IoStream& image_stream, u64 offset);
+
+	// re-hashes the level 2 blocks touching the modified ranges and then their parents, level 2 must keep its size
+	void UpdateTree(IoStream& level_2_stream, u64 offset, const std::vector<sRange>& modified_ranges);
+
+	const IvfcHeader& GetHeader() const;
+	const u8* GetMasterHash() const;
+	size_t GetMasterHashSize() const;
+	const u8* GetLevelData(size_t index) const; // hash levels only, zero padded to the level block size
+	u64 GetImageSize() const;
+
+	// header, master hash and padding, the part of the image in front of level 2
+	void SerialiseImageHeader(MemoryBlob& data) const;
+	// hash of the first hashed_size bytes of the image, for NcchHeader::SetRomfsData()
+	void HashImageHeader(u64 hashed_size, u8 hash[Crypto::kSha256HashLen]) const;
+
+private:
+	const std::string kModuleName = "IVFC_BUILDER";
+	static const size_t kIoBufferLen = 0x1000000;
+	static const size_t kUpdateBatchLen = 0x100000; // updates are split into jobs this size
+
+	IvfcHeader header_;
+	MemoryBlob master_hash_;
+	MemoryBlob level_[IvfcHeader::kLevelNum - 1];
+
+	void InitialiseTree(u64 size, IvfcHeader::IvfcType type);
+	void AllocateLevels();
+	void HashLevel2(IoStream& level_2_stream, u64 offset, u64 size, OutputFile* image);
+	void HashLevel(const MemoryBlob& level, size_t index, u8* hashes);
+	void UpdateLevel(size_t index, const std::vector<u64>& dirty_hashes, std::vector<u64>& dirty_blocks);
+};
@@ -95,7 +95,8 @@ void IvfcHeader::SerialiseData(u64 level_2_size, IvfcType type)
 	// Commit static data
 	hdr->set_struct_signature(kIvfcStructSignature);
 	hdr->set_type(type_);
-	hdr->set_optional_size(sizeof(sIvfcHeader));
+	optional_size_ = sizeof(sIvfcHeader);
+	hdr->set_optional_size(optional_size_);
 
 	// Generate logical IVFC layout
 	u64 block_size = GetDefaultBlockSize(type_);
@@ -104,21 +105,22 @@ void IvfcHeader::SerialiseData(u64 level_2_size, IvfcType type)
 	level_[2].set_size(level_2_size);
 	level_[2].set_block_size(block_size);
 
-	// 2. calulate hash levels
-	for (size_t i = 1; i <= 0; i--)
+	// 2. calulate hash levels, each holds one hash per block of the level below it
+	for (size_t i = kLevelNum - 1; i > 0; i--)
 	{
-		level_[i].set_size(CalculateHashNum(level_[i+1].size(), level_[i+1].block_size()) * Crypto::kSha256HashLen);
-		level_[i].set_block_size(block_size);
+		level_[i-1].set_size(CalculateHashNum(level_[i].size(), level_[i].block_size()) * Crypto::kSha256HashLen);
+		level_[i-1].set_block_size(block_size);
 	}
 
 	// 3. determine master hash size
 	master_hash_size_ = CalculateHashNum(level_[0].size(), level_[0].block_size()) * Crypto::kSha256HashLen;
+	hdr->set_master_hash_size(master_hash_size_);
 
 	// 4. calculate level offsets
 	level_[0].set_offset(0);
 	for (size_t i = 1; i < kLevelNum; i++)
 	{
-		level_[i].set_offset(align(level_[i-1].size(), level_[i-1].block_size()));
+		level_[i].set_offset(level_[i-1].offset() + align(level_[i-1].size(), level_[i-1].block_size()));
 	}
 
 	// Commit Level data
@@ -155,12 +157,25 @@ void IvfcHeader::DeserialiseData(const u8 * data)
 	optional_size_ = hdr->optional_size();
 	for (size_t i = 0; i < kLevelNum; i++)
 	{
+		// the block size is stored as a shift, so it is bounded before anything sizes a buffer from it
+		if (hdr->level(i).block_size_log2() < kMinBlockSizeLog2 || hdr->level(i).block_size_log2() > kMaxBlockSizeLog2)
+		{
+			throw ProjectSnakeException(kModuleName, "IVFC header is corrupt (invalid block size)");
+		}
+
 		level_[i].set_offset(hdr->level(i).offset());
 		level_[i].set_size(hdr->level(i).size());
 		level_[i].set_block_size(hdr->level(i).block_size());
 	}
 }
 
+void IvfcHeader::DeserialiseData(IoStream& stream, u64 offset)
+{
+	u8 data[sizeof(sIvfcHeader)];
+	stream.read(offset, sizeof(sIvfcHeader), data);
+	DeserialiseData(data);
+}
+
 IvfcHeader::IvfcType IvfcHeader::GetType() const
 {
 	return type_;
@@ -206,6 +221,33 @@ u64 IvfcHeader::GetLevelAlignedSize(size_t index) const
 	return align(GetLevelSize(index), GetLevelBlockSize(index));
 }
 
+u64 IvfcHeader::GetMasterHashOffset() const
+{
+	return align(sizeof(sIvfcHeader), kMasterHashAlignSize);
+}
+
+u64 IvfcHeader::GetLevelDataOffset(size_t index) const
+{
+	if (index >= kLevelNum)
+	{
+		throw ProjectSnakeException(kModuleName, "Illegal IVFC level");
+	}
+
+	// level 2 comes first so the file data is near the front, then the hash levels in order
+	u64 offset = align(GetMasterHashOffset() + master_hash_size_, GetLevelBlockSize(kLevelNum - 1));
+	if (index == kLevelNum - 1)
+	{
+		return offset;
+	}
+
+	offset += GetLevelSize(kLevelNum - 1);
+	for (size_t i = 0; i < index; i++)
+	{
+		offset = align(offset, GetLevelBlockSize(i)) + GetLevelSize(i);
+	}
+	return align(offset, GetLevelBlockSize(index));
+}
+
 u32 IvfcHeader::GetOptionalSize() const
 {
 	return optional_size_;
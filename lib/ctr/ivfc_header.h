@@ -2,6 +2,7 @@
 #include <cmath>
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
 #include <crypto/crypto.h>
 
 class IvfcHeader
@@ -32,6 +33,7 @@ public:
 
 	// Data Deserialisation
 	void DeserialiseData(const u8* data);
+	void DeserialiseData(IoStream& stream, u64 offset);
 	IvfcType GetType() const;
 	u32 GetMasterHashSize() const;
 	u32 GetOptionalSize() const;
@@ -40,12 +42,19 @@ public:
 	u64 GetLevelBlockSize(size_t index) const;
 	u64 GetLevelAlignedSize(size_t index) const;
 
+	// where the master hash and levels sit in the IVFC image: header, master hash, level 2 then the hash levels
+	u64 GetMasterHashOffset() const;
+	u64 GetLevelDataOffset(size_t index) const;
+
 
 private:
 	const std::string kModuleName = "IVFC_HEADER";
 	const char kIvfcStructSignature[4] = { 'I', 'V', 'F', 'C' };
 	static const size_t kDefaultRomfsBlockSize = 0x1000;
 	static const size_t kDefaultExtdataBlockSize = 0x200;
+	static const size_t kMasterHashAlignSize = 0x10;
+	static const u32 kMinBlockSizeLog2 = 9; // 0x200, block sizes outside this range are treated as corruption
+	static const u32 kMaxBlockSizeLog2 = 20; // 0x100000
 
 #pragma pack (push, 1)
 	struct sIvfcLevel
@@ -59,6 +68,7 @@ private:
 		u64 offset() const { return le_dword(offset_); }
 		u64 size() const { return le_dword(size_); }
 		u64 block_size() const { return (u64)1 << (u64)le_word(block_size_); }
+		u32 block_size_log2() const { return le_word(block_size_); }
 
 		void clear() { memset(this, 0, sizeof(*this)); }
 
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <crypto/crypto.h>
+#include "ivfc_stream.h"
+
+IvfcStream::IvfcStream(IoStream& image_stream, u64 offset) :
+	IvfcStream(image_stream, offset, kDefaultCacheBlockNum)
+{
+}
+
+IvfcStream::IvfcStream(IoStream& image_stream, u64 offset, size_t cache_block_num) :
+	image_stream_(image_stream),
+	image_offset_(offset),
+	cache_block_num_(cache_block_num > 0 ? cache_block_num : 1) // a hash block must stay cached while it is in use
+{
+	header_.DeserialiseData(image_stream_, image_offset_);
+
+	// block sizes are bounded by the header, every level must be hashed completely by the level above it
+	for (size_t i = 0; i < IvfcHeader::kLevelNum; i++)
+	{
+		u64 hash_size = i == 0 ? header_.GetMasterHashSize() : header_.GetLevelSize(i - 1);
+		if (GetBlockNum(i) > hash_size / Crypto::kSha256HashLen)
+		{
+			throw ProjectSnakeException(kModuleName, "IVFC header is corrupt (hash level too small)");
+		}
+		verified_[i].resize((size_t)GetBlockNum(i), false);
+	}
+
+	master_hash_.resize(header_.GetMasterHashSize());
+	image_stream_.read(image_offset_ + header_.GetMasterHashOffset(), master_hash_.size(), master_hash_.data());
+}
+
+IvfcStream::~IvfcStream()
+{
+}
+
+const IvfcHeader& IvfcStream::GetHeader() const
+{
+	return header_;
+}
+
+u64 IvfcStream::GetVerifiedBlockNum(size_t level)
+{
+	if (level >= IvfcHeader::kLevelNum)
+	{
+		throw ProjectSnakeException(kModuleName, "Illegal IVFC level");
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	return std::count(verified_[level].begin(), verified_[level].end(), true);
+}
+
+u64 IvfcStream::size()
+{
+	return header_.GetLevelSize(2);
+}
+
+void IvfcStream::read(u64 offset, size_t size, u8* out)
+{
+	if (offset > header_.GetLevelSize(2) || size > header_.GetLevelSize(2) - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to read beyond end of IVFC level 2");
+	}
+
+	// the lock only covers the bitmap and the hash block cache, level 2 data is read and hashed outside it
+	const u64 block_size = header_.GetLevelBlockSize(2);
+	const u64 batch_block_num = block_size < kIoBufferLen ? kIoBufferLen / block_size : 1;
+	std::vector<u8> buffer;
+	std::vector<u8> hashes;
+	u64 block = offset / block_size;
+	u64 end_block = align(offset + size, block_size) / block_size;
+	while (block < end_block)
+	{
+		// split the read into runs of blocks that are all verified, or all not yet verified
+		bool is_verified;
+		u64 run_end = block + 1;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			is_verified = verified_[2][(size_t)block];
+			while (run_end < end_block && verified_[2][(size_t)run_end] == is_verified && (is_verified || run_end - block < batch_block_num))
+			{
+				run_end++;
+			}
+		}
+
+		u64 run_start_pos = std::max<u64>(block * block_size, offset);
+		u64 run_end_pos = std::min<u64>(run_end * block_size, offset + size);
+		if (is_verified)
+		{
+			image_stream_.read(image_offset_ + header_.GetLevelDataOffset(2) + run_start_pos, (size_t)(run_end_pos - run_start_pos), out + (run_start_pos - offset));
+		}
+		else
+		{
+			// whole blocks have to be read to hash them
+			buffer.resize((size_t)((run_end - block) * block_size));
+			hashes.resize((size_t)(run_end - block) * Crypto::kSha256HashLen);
+			ReadBlocks(2, block, run_end - block, buffer.data());
+			Crypto::Sha256BatchSerial(buffer.data(), (size_t)(run_end - block), (size_t)block_size, hashes.data());
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				CheckHashes(2, block, run_end - block, hashes.data());
+			}
+			memcpy(out + (run_start_pos - offset), buffer.data() + (run_start_pos - block * block_size), (size_t)(run_end_pos - run_start_pos));
+		}
+
+		block = run_end;
+	}
+}
+
+u64 IvfcStream::GetBlockNum(size_t level) const
+{
+	return align(header_.GetLevelSize(level), header_.GetLevelBlockSize(level)) / header_.GetLevelBlockSize(level);
+}
+
+const u8* IvfcStream::GetExpectedHash(size_t level, u64 index)
+{
+	if (level == 0)
+	{
+		return master_hash_.data() + index * Crypto::kSha256HashLen;
+	}
+
+	u64 hash_num = header_.GetLevelBlockSize(level - 1) / Crypto::kSha256HashLen;
+	return GetHashBlock(level - 1, index / hash_num) + (index % hash_num) * Crypto::kSha256HashLen;
+}
+
+const u8* IvfcStream::GetHashBlock(size_t level, u64 index)
+{
+	auto itr = cache_index_.find(std::make_pair(level, index));
+	if (itr != cache_index_.end())
+	{
+		cache_.splice(cache_.begin(), cache_, itr->second);
+		return itr->second->data.data();
+	}
+
+	// the block is verified before it is cached, which may pull its parents into the cache first
+	sCachedBlock block;
+	block.level = level;
+	block.index = index;
+	block.data.resize((size_t)header_.GetLevelBlockSize(level));
+	u8 hash[Crypto::kSha256HashLen];
+	ReadBlocks(level, index, 1, block.data.data());
+	Crypto::Sha256(block.data.data(), block.data.size(), hash);
+	CheckHashes(level, index, 1, hash);
+
+	cache_.push_front(std::move(block));
+	cache_index_[std::make_pair(level, index)] = cache_.begin();
+	while (cache_.size() > cache_block_num_)
+	{
+		cache_index_.erase(std::make_pair(cache_.back().level, cache_.back().index));
+		cache_.pop_back();
+	}
+
+	return cache_.front().data.data();
+}
+
+void IvfcStream::ReadBlocks(size_t level, u64 first, u64 num, u8* out) const
+{
+	// the last block of a level is hashed as if padded with zeros
+	u64 block_size = header_.GetLevelBlockSize(level);
+	u64 start = first * block_size;
+	u64 read_size = std::min<u64>(num * block_size, header_.GetLevelSize(level) - start);
+	image_stream_.read(image_offset_ + header_.GetLevelDataOffset(level) + start, (size_t)read_size, out);
+	memset(out + read_size, 0, (size_t)(num * block_size - read_size));
+}
+
+void IvfcStream::CheckHashes(size_t level, u64 first, u64 num, const u8* hashes)
+{
+	// data that was hashed is always compared, a verified bit only means the block was good when it was last read
+	for (u64 i = 0; i < num; i++)
+	{
+		if (memcmp(hashes + i * Crypto::kSha256HashLen, GetExpectedHash(level, first + i), Crypto::kSha256HashLen) != 0)
+		{
+			throw ProjectSnakeException(kModuleName, "IVFC level " + std::to_string(level) + " block " + std::to_string(first + i) + " failed verification");
+		}
+		verified_[level][(size_t)(first + i)] = true;
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <fnd/types.h>
+#include <fnd/io_stream.h>
+#include <ctr/ivfc_header.h>
+
+/*
+ Level 2 of an IVFC image, verified as it is read.
+ A block is only hashed the first time a read touches it, and its hash
+ is checked against the hash levels above it, which are verified the same
+ way up to the master hash. Verified blocks are remembered in a bitmap,
+ and recently used hash blocks are kept in a small LRU cache. The master
+ hash is trusted as read, it is covered by the NCCH RomFS hash. The stream
+ must outlive this object and support concurrent reads. Reads are thread
+ safe, level 2 data is read and hashed outside the lock.
+*/
+class IvfcStream : public IoStream
+{
+public:
+	static const size_t kDefaultCacheBlockNum = 64;
+
+	IvfcStream(IoStream& image_stream, u64 offset); // offset is where the IVFC image starts in the stream
+	IvfcStream(IoStream& image_stream, u64 offset, size_t cache_block_num);
+	~IvfcStream();
+
+	const IvfcHeader& GetHeader() const;
+	u64 GetVerifiedBlockNum(size_t level);
+
+	u64 size();
+	void read(u64 offset, size_t size, u8* out);
+
+private:
+	const std::string kModuleName = "IVFC_STREAM";
+	static const size_t kIoBufferLen = 0x100000;
+
+	struct sCachedBlock
+	{
+		size_t level;
+		u64 index;
+		std::vector<u8> data;
+	};
+
+	IoStream& image_stream_;
+	u64 image_offset_;
+	IvfcHeader header_;
+	std::vector<u8> master_hash_;
+
+	std::mutex mutex_;
+	std::vector<bool> verified_[IvfcHeader::kLevelNum];
+
+	// front is most recently used, only hash level blocks are cached
+	size_t cache_block_num_;
+	std::list<sCachedBlock> cache_;
+	std::map<std::pair<size_t, u64>, std::list<sCachedBlock>::iterator> cache_index_;
+
+	u64 GetBlockNum(size_t level) const;
+
+	// these require mutex_ to be held
+	const u8* GetExpectedHash(size_t level, u64 index);
+	const u8* GetHashBlock(size_t level, u64 index);
+	void CheckHashes(size_t level, u64 first, u64 num, const u8* hashes);
+
+	void ReadBlocks(size_t level, u64 first, u64 num, u8* out) const;
+};
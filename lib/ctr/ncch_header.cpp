@@ -67,7 +67,7 @@ void NcchHeader::SerialiseHeader(const Crypto::sRsa2048Key& ncch_rsa_key, Format
 	else if (format_version == NCCH_FORMAT_1)
 	{
 		format_id_ = form_type_ == FormType::SIMPLE_CONTENT ? NCCH_CFA : NCCH_CXI;
-		block_size_bit_ = log2l(block_size_) - 9;
+		block_size_bit_ = log2l(block_size_);
 		if (BIT(block_size_bit_) != block_size_) 
 		{
 			throw ProjectSnakeException(kModuleName, "Block size is invalid for current NCCH format");
@@ -121,13 +121,20 @@ void NcchHeader::SerialiseHeader(const Crypto::sRsa2048Key& ncch_rsa_key, Format
 			if (is_seeded_keyy_)
 			{
 				hdr->body.set_other_flag_bit(MANUAL_DISCLOSURE, is_manual_disclosed_);
+
+				// readers check the seed against this before using it
+				struct sSeedValidateStruct seed_validate;
+				seed_validate.set_seed(preload_seed_);
+				seed_validate.set_program_id(program_id_);
+				seed_checksum_ = seed_validate.seed_checksum();
+				hdr->body.set_seed_checksum(seed_checksum_);
 			}
 			
 		}
 	}
 	else
 	{
-		hdr->body.set_other_flag_bit(NO_AES, false);
+		hdr->body.set_other_flag_bit(NO_AES, true);
 		hdr->body.set_key_id(0);
 	}
 
@@ -208,7 +215,7 @@ void NcchHeader::SetContentType(ContentType type)
 void NcchHeader::SetBlockSize(u32 size)
 {
 	block_size_ = size;
-	block_size_bit_ = log2l(size) - 9;
+	block_size_bit_ = log2l(size);
 }
 
 void NcchHeader::DisableEncryption()
@@ -333,6 +340,13 @@ void NcchHeader::DeserialiseHeader(const u8* ncch_data)
 	romfs_.set_hash(hdr->body.romfs_hash());
 }
 
+void NcchHeader::DeserialiseHeader(IoStream& stream, u64 offset)
+{
+	u8 data[sizeof(sSignedNcchHeader)];
+	stream.read(offset, sizeof(sSignedNcchHeader), data);
+	DeserialiseHeader(data);
+}
+
 bool NcchHeader::ValidateSignature(const Crypto::sRsa2048Key & ncch_rsa_key) const
 {
 	const struct sSignedNcchHeader* data = (const struct sSignedNcchHeader*)serialised_data_.data();
@@ -1,6 +1,7 @@
 #pragma once
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
 #include <crypto/crypto.h>
 
 class NcchHeader
@@ -80,6 +81,7 @@ public:
 
 	// Header Deserialisation
 	void DeserialiseHeader(const u8* ncch_data);
+	void DeserialiseHeader(IoStream& stream, u64 offset);
 	bool ValidateSignature(const Crypto::sRsa2048Key& ncch_rsa_key) const;
 	bool ValidatePreloadSeed(const u8 seed[Crypto::kAes128KeySize]);
 	u64 GetNcchSize() const;
@@ -221,7 +223,7 @@ private:
 		ContentType content_type() const { return (ContentType)(flags_.content_type >> 2); }
 		u8 block_size() const { return flags_.block_size; }
 		u8 other_flag() const { return flags_.other_flag; }
-		bool other_flag_bit(u8 bit) const { return ((flags_.other_flag > bit) & 1) == true; }
+		bool other_flag_bit(u8 bit) const { return ((flags_.other_flag >> bit) & 1) == 1; }
 		const sSectionGeometry& plain_region() const { return plain_region_; }
 		const sSectionGeometry& logo() const { return logo_; }
 		const sHashedSectionGeometry& exefs() const { return exefs_; }
@@ -280,7 +282,7 @@ private:
 
 		void clear() { memset(this, 0, sizeof(sSeedValidateStruct)); }
 
-		void set_seed(const u8* seed) { memcpy(seed_, seed, Crypto::kSha256HashLen); }
+		void set_seed(const u8* seed) { memcpy(seed_, seed, Crypto::kAes128KeySize); }
 		void set_program_id(u64 program_id) { program_id_ = le_dword(program_id); }
 	};
 #pragma pack (pop)
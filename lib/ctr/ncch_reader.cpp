@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <fnd/thread_pool.h>
+#include "ncch_reader.h"
+
+NcchReader::NcchReader() :
+	ncch_stream_(nullptr),
+	ncch_offset_(0),
+	is_key_set_(false)
+{
+}
+
+NcchReader::~NcchReader()
+{
+}
+
+void NcchReader::ImportNcch(IoStream& ncch_stream, u64 offset)
+{
+	header_.DeserialiseHeader(ncch_stream, offset);
+	if (offset > ncch_stream.size() || header_.GetNcchSize() > ncch_stream.size() - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "NCCH is larger than the stream holding it");
+	}
+
+	ncch_stream_ = &ncch_stream;
+	ncch_offset_ = offset;
+	is_key_set_ = false;
+	crypt_regions_.reset(new AesCtrRegionIndex());
+
+	// without encryption the exefs header can be parsed straight away
+	if (header_.IsEncrypted() == false && header_.GetExefsSize() > 0)
+	{
+		exefs_header_.DeserialiseData(ncch_stream, offset + header_.GetExefsOffset());
+	}
+}
+
+void NcchReader::SetFixedAesKey(const u8 key[Crypto::kAes128KeySize])
+{
+	SetAesKeys(key, key);
+}
+
+void NcchReader::SetAesKeyX(const u8 key_x[Crypto::kAes128KeySize], const u8 secondary_key_x[Crypto::kAes128KeySize])
+{
+	u8 key[Crypto::kAes128KeySize], secondary_key[Crypto::kAes128KeySize];
+	header_.GenerateAesKey(key_x, key);
+	header_.GenerateAesKey(secondary_key_x, secondary_key);
+	SetAesKeys(key, secondary_key);
+}
+
+void NcchReader::SetAesKeyX(const u8 key_x[Crypto::kAes128KeySize], const u8 secondary_key_x[Crypto::kAes128KeySize], const u8 seed[Crypto::kAes128KeySize])
+{
+	// GenerateAesKey() silently leaves the key untouched for a bad seed
+	if (header_.HasPreloadSeed() && header_.ValidatePreloadSeed(seed) == false)
+	{
+		throw ProjectSnakeException(kModuleName, "Seed does not match the NCCH seed checksum");
+	}
+
+	u8 key[Crypto::kAes128KeySize], secondary_key[Crypto::kAes128KeySize];
+	header_.GenerateAesKey(key_x, key);
+	header_.GenerateAesKey(secondary_key_x, seed, secondary_key);
+	SetAesKeys(key, secondary_key);
+}
+
+const NcchHeader& NcchReader::GetHeader() const
+{
+	return header_;
+}
+
+const ExefsHeader& NcchReader::GetExefsHeader() const
+{
+	return exefs_header_;
+}
+
+u64 NcchReader::size()
+{
+	return header_.GetNcchSize();
+}
+
+void NcchReader::read(u64 offset, size_t size, u8* out)
+{
+	if (ncch_stream_ == nullptr)
+	{
+		throw ProjectSnakeException(kModuleName, "No NCCH imported");
+	}
+	if (offset > header_.GetNcchSize() || size > header_.GetNcchSize() - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to read beyond end of NCCH");
+	}
+
+	// the regions are only looked up here, so concurrent reads don't need a lock
+	ncch_stream_->read(ncch_offset_ + offset, size, out);
+	crypt_regions_->crypt((size_t)offset, size, out);
+}
+
+void NcchReader::ReadExheader(u64 offset, size_t size, u8* out)
+{
+	ReadSection(header_.GetExheaderOffset(), header_.GetExheaderSize() > 0 ? header_.GetExheaderSize() + kAccessDescriptorSize : 0, offset, size, out);
+}
+
+void NcchReader::ReadExefs(u64 offset, size_t size, u8* out)
+{
+	ReadSection(header_.GetExefsOffset(), header_.GetExefsSize(), offset, size, out);
+}
+
+void NcchReader::ReadRomfs(u64 offset, size_t size, u8* out)
+{
+	ReadSection(header_.GetRomfsOffset(), header_.GetRomfsSize(), offset, size, out);
+}
+
+bool NcchReader::ValidateSections()
+{
+	sSectionValidationReport report;
+	return ValidateSections(report);
+}
+
+bool NcchReader::ValidateSections(sSectionValidationReport& report)
+{
+	if (ncch_stream_ == nullptr)
+	{
+		throw ProjectSnakeException(kModuleName, "No NCCH imported");
+	}
+	if (header_.IsEncrypted() && is_key_set_ == false)
+	{
+		throw ProjectSnakeException(kModuleName, "AES keys are required to read encrypted sections");
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// every check is a job for one section, large IVFC levels are split into many jobs for the same section
+	struct sJob
+	{
+		size_t section;
+		std::function<bool()> check;
+	};
+	std::vector<sJob> jobs;
+
+	report.sections.clear();
+	report.total_size = 0;
+	auto add_section = [&report](const std::string& name, u64 size)
+	{
+		sSectionValidation section = { name, size, true };
+		report.sections.push_back(section);
+		report.total_size += size;
+		return report.sections.size() - 1;
+	};
+	auto add_hash_job = [this, &jobs](size_t section, u64 offset, u64 size, const u8* hash)
+	{
+		sJob job = { section, std::bind(&NcchReader::ValidateHash, this, offset, size, hash) };
+		jobs.push_back(job);
+	};
+
+	if (header_.GetExheaderSize() > 0)
+	{
+		add_hash_job(add_section("exheader", header_.GetExheaderSize()), header_.GetExheaderOffset(), header_.GetExheaderSize(), header_.GetExheaderHash());
+	}
+
+	if (header_.GetLogoSize() > 0)
+	{
+		add_hash_job(add_section("logo", header_.GetLogoSize()), header_.GetLogoOffset(), header_.GetLogoSize(), header_.GetLogoHash());
+	}
+
+	if (header_.GetExefsSize() > 0)
+	{
+		add_hash_job(add_section("exefs", header_.GetExefsHashedRegionSize()), header_.GetExefsOffset(), header_.GetExefsHashedRegionSize(), header_.GetExefsHash());
+		for (const auto& file : exefs_header_.GetExefsFiles())
+		{
+			u64 offset = header_.GetExefsOffset() + kExefsHeaderSize + file.offset;
+			size_t section = add_section("exefs/" + file.name, file.size);
+			if (offset + file.size > header_.GetExefsOffset() + header_.GetExefsSize())
+			{
+				report.sections[section].is_valid = false;
+				continue;
+			}
+			add_hash_job(section, offset, file.size, file.hash);
+		}
+	}
+
+	// the ivfc header and master hash are covered by the romfs hash, each level is covered by the one before it
+	IvfcHeader ivfc;
+	std::vector<u8> master_hash;
+	if (header_.GetRomfsSize() > 0)
+	{
+		u64 romfs_offset = header_.GetRomfsOffset();
+		u64 romfs_size = header_.GetRomfsSize();
+		add_hash_job(add_section("romfs", header_.GetRomfsHashedRegionSize()), romfs_offset, header_.GetRomfsHashedRegionSize(), header_.GetRomfsHash());
+
+		bool is_ivfc_valid = true;
+		try
+		{
+			// block sizes are bounded by the header, level sizes are bounded by the romfs before any offset is summed from them
+			ivfc.DeserialiseData(*this, romfs_offset);
+			if (ivfc.GetMasterHashOffset() + ivfc.GetMasterHashSize() > romfs_size)
+			{
+				is_ivfc_valid = false;
+			}
+			for (size_t i = 0; i < IvfcHeader::kLevelNum && is_ivfc_valid; i++)
+			{
+				if (ivfc.GetLevelSize(i) > romfs_size)
+				{
+					is_ivfc_valid = false;
+				}
+			}
+			for (size_t i = 0; i < IvfcHeader::kLevelNum && is_ivfc_valid; i++)
+			{
+				u64 hash_num = align(ivfc.GetLevelSize(i), ivfc.GetLevelBlockSize(i)) / ivfc.GetLevelBlockSize(i);
+				u64 hash_size = i == 0 ? ivfc.GetMasterHashSize() : ivfc.GetLevelSize(i - 1);
+				if (ivfc.GetLevelDataOffset(i) > romfs_size - ivfc.GetLevelSize(i) || hash_num > hash_size / Crypto::kSha256HashLen)
+				{
+					is_ivfc_valid = false;
+				}
+			}
+		}
+		catch (const std::exception&)
+		{
+			is_ivfc_valid = false;
+		}
+
+		if (is_ivfc_valid == false)
+		{
+			report.sections[add_section("romfs/ivfc", 0)].is_valid = false;
+		}
+		else
+		{
+			master_hash.resize(ivfc.GetMasterHashSize());
+			read(romfs_offset + ivfc.GetMasterHashOffset(), master_hash.size(), master_hash.data());
+
+			for (size_t i = 0; i < IvfcHeader::kLevelNum; i++)
+			{
+				size_t section = add_section("romfs/level " + std::to_string(i), ivfc.GetLevelSize(i));
+				u64 block_size = ivfc.GetLevelBlockSize(i);
+				u64 block_num = align(ivfc.GetLevelSize(i), block_size) / block_size;
+				u64 batch_block_num = block_size < kIoBufferLen ? kIoBufferLen / block_size : 1;
+
+				// the expected hashes for a batch are read by the job itself, so only the batches in flight are in memory
+				for (u64 first = 0; first < block_num; first += batch_block_num)
+				{
+					u64 num = std::min<u64>(batch_block_num, block_num - first);
+					sJob job = { section, [this, &ivfc, &master_hash, romfs_offset, i, first, num]()
+					{
+						std::vector<u8> expected_hashes;
+						if (i == 0)
+						{
+							expected_hashes.assign(master_hash.begin() + first * Crypto::kSha256HashLen, master_hash.begin() + (first + num) * Crypto::kSha256HashLen);
+						}
+						else
+						{
+							expected_hashes.resize(num * Crypto::kSha256HashLen);
+							read(romfs_offset + ivfc.GetLevelDataOffset(i - 1) + first * Crypto::kSha256HashLen, expected_hashes.size(), expected_hashes.data());
+						}
+						return ValidateIvfcBlocks(ivfc, i, first, num, expected_hashes.data());
+					} };
+					jobs.push_back(job);
+				}
+			}
+		}
+	}
+
+	// each job only writes its own flag, the flags are folded into the sections once the pool is done
+	std::vector<u8> job_results(jobs.size(), false);
+	ThreadPool pool(jobs.size() < ThreadPool::default_thread_num() ? (jobs.size() > 0 ? jobs.size() : 1) : ThreadPool::default_thread_num());
+	report.thread_num = pool.thread_num();
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		pool.submit([&jobs, &job_results, i]()
+		{
+			try
+			{
+				job_results[i] = jobs[i].check();
+			}
+			catch (const std::exception&)
+			{
+				job_results[i] = false;
+			}
+		});
+	}
+	pool.wait();
+
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		if (job_results[i] == false)
+		{
+			report.sections[jobs[i].section].is_valid = false;
+		}
+	}
+
+	report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return report.is_valid();
+}
+
+bool NcchReader::sSectionValidationReport::is_valid() const
+{
+	for (const auto& section : sections)
+	{
+		if (section.is_valid == false)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+double NcchReader::sSectionValidationReport::bytes_per_second() const
+{
+	return seconds > 0 ? (double)total_size / seconds : 0;
+}
+
+void NcchReader::SetAesKeys(const u8 key[Crypto::kAes128KeySize], const u8 secondary_key[Crypto::kAes128KeySize])
+{
+	if (ncch_stream_ == nullptr)
+	{
+		throw ProjectSnakeException(kModuleName, "No NCCH imported");
+	}
+	if (header_.IsEncrypted() == false)
+	{
+		return;
+	}
+
+	// regions can't be removed, so new keys start from a fresh index
+	crypt_regions_.reset(new AesCtrRegionIndex());
+	is_key_set_ = false;
+
+	u64 exheader_offset = header_.GetExheaderOffset();
+	if (header_.GetExheaderSize() > 0)
+	{
+		AddRegion(NcchHeader::SECTION_EXHEADER, exheader_offset, exheader_offset, exheader_offset + header_.GetExheaderSize() + kAccessDescriptorSize, key);
+	}
+
+	u64 exefs_offset = header_.GetExefsOffset();
+	u64 exefs_end = exefs_offset + header_.GetExefsSize();
+	if (header_.GetExefsSize() > 0)
+	{
+		// the exefs header uses the primary key, and locates the files that don't
+		u8 ctr[Crypto::kAesBlockSize];
+		header_.InitialiseAesCtr(NcchHeader::SECTION_EXEFS, ctr);
+
+		std::vector<u8> exefs_header(kExefsHeaderSize);
+		ncch_stream_->read(ncch_offset_ + exefs_offset, exefs_header.size(), exefs_header.data());
+		Crypto::AesCtr(exefs_header.data(), exefs_header.size(), key, ctr, exefs_header.data());
+		exefs_header_.DeserialiseData(exefs_header.data());
+
+		// icon and banner stay on the primary key, everything else is on the secondary key
+		std::vector<std::pair<u64, u64>> secondary_ranges;
+		for (const auto& file : exefs_header_.GetExefsFiles())
+		{
+			if (file.name == "icon" || file.name == "banner" || file.size == 0)
+			{
+				continue;
+			}
+
+			u64 start = exefs_offset + exefs_header.size() + file.offset;
+			u64 end = std::min<u64>(align(start + file.size, Crypto::kAesBlockSize), exefs_end);
+			if (start < end)
+			{
+				secondary_ranges.push_back(std::make_pair(start, end));
+			}
+		}
+		std::sort(secondary_ranges.begin(), secondary_ranges.end());
+
+		// fill in the gaps around the secondary key ranges with the primary key
+		u64 pos = exefs_offset;
+		for (const auto& range : secondary_ranges)
+		{
+			if (range.first < pos)
+			{
+				throw ProjectSnakeException(kModuleName, "ExeFS files overlap");
+			}
+			if (range.first > pos)
+			{
+				AddRegion(NcchHeader::SECTION_EXEFS, exefs_offset, pos, range.first, key);
+			}
+			AddRegion(NcchHeader::SECTION_EXEFS, exefs_offset, range.first, range.second, secondary_key);
+			pos = range.second;
+		}
+		if (pos < exefs_end)
+		{
+			AddRegion(NcchHeader::SECTION_EXEFS, exefs_offset, pos, exefs_end, key);
+		}
+	}
+
+	if (header_.GetRomfsSize() > 0)
+	{
+		AddRegion(NcchHeader::SECTION_ROMFS, header_.GetRomfsOffset(), header_.GetRomfsOffset(), header_.GetRomfsOffset() + header_.GetRomfsSize(), secondary_key);
+	}
+
+	is_key_set_ = true;
+}
+
+void NcchReader::AddRegion(NcchHeader::AesCtrSectionId section, u64 section_offset, u64 start, u64 end, const u8 key[Crypto::kAes128KeySize])
+{
+	if ((start - section_offset) % Crypto::kAesBlockSize != 0)
+	{
+		throw ProjectSnakeException(kModuleName, "AES region is not block aligned");
+	}
+
+	// the section counter is for the start of the section, regions inside it start further along
+	u8 section_ctr[Crypto::kAesBlockSize], ctr[Crypto::kAesBlockSize];
+	header_.InitialiseAesCtr(section, section_ctr);
+	Crypto::AesIncrementCounter(section_ctr, (size_t)((start - section_offset) / Crypto::kAesBlockSize), ctr);
+
+	crypt_regions_->AddRegion((size_t)start, (size_t)end, key, ctr);
+}
+
+bool NcchReader::ValidateHash(u64 offset, u64 size, const u8 hash[Crypto::kSha256HashLen])
+{
+	if (offset > header_.GetNcchSize() || size > header_.GetNcchSize() - offset)
+	{
+		return false;
+	}
+
+	// each chunk is hashed straight after it is decrypted, while it is still in cache
+	std::vector<u8> buffer(size < kIoBufferLen ? (size_t)size : kIoBufferLen);
+	Crypto::sSha256Context ctx;
+	Crypto::Sha256Init(ctx);
+	for (u64 pos = 0; pos < size; pos += buffer.size())
+	{
+		size_t read_size = (size_t)std::min<u64>(buffer.size(), size - pos);
+		read(offset + pos, read_size, buffer.data());
+		Crypto::Sha256Update(ctx, buffer.data(), read_size);
+	}
+
+	u8 calc_hash[Crypto::kSha256HashLen];
+	Crypto::Sha256Final(ctx, calc_hash);
+	return memcmp(calc_hash, hash, Crypto::kSha256HashLen) == 0;
+}
+
+bool NcchReader::ValidateIvfcBlocks(const IvfcHeader& ivfc, size_t level, u64 first_block, u64 block_num, const u8* expected_hashes)
+{
+	// the last block is hashed as if padded with zeros to the block size
+	u64 block_size = ivfc.GetLevelBlockSize(level);
+	u64 start = first_block * block_size;
+	std::vector<u8> blocks((size_t)(block_num * block_size), 0);
+	read(header_.GetRomfsOffset() + ivfc.GetLevelDataOffset(level) + start, (size_t)std::min<u64>(blocks.size(), ivfc.GetLevelSize(level) - start), blocks.data());
+
+	std::vector<u8> hashes((size_t)block_num * Crypto::kSha256HashLen);
+	Crypto::Sha256BatchSerial(blocks.data(), (size_t)block_num, (size_t)block_size, hashes.data());
+	return memcmp(hashes.data(), expected_hashes, hashes.size()) == 0;
+}
+
+void NcchReader::ReadSection(u64 section_offset, u64 section_size, u64 offset, size_t size, u8* out)
+{
+	if (offset > section_size || size > section_size - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to read beyond end of section");
+	}
+	if (header_.IsEncrypted() && is_key_set_ == false)
+	{
+		throw ProjectSnakeException(kModuleName, "AES keys are required to read encrypted sections");
+	}
+
+	read(section_offset + offset, size, out);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <fnd/types.h>
+#include <fnd/io_stream.h>
+#include <crypto/crypto.h>
+#include <crypto/aes_ctr_region_index.h>
+#include <ctr/ncch_header.h>
+#include <ctr/exefs_header.h>
+#include <ctr/ivfc_header.h>
+
+/*
+ Decrypted, random access view of an NCCH stored in an IoStream.
+ Once the keys are set, the exheader, ExeFS and RomFS are registered as
+ AES-CTR regions and only the bytes a read covers are decrypted. The
+ exheader, ExeFS header, icon and banner use the primary key, the rest
+ of the ExeFS and the RomFS use the secondary key (selected by the key id,
+ optionally seeded). The stream must outlive the reader. Once the keys
+ are set, reads are thread safe.
+*/
+class NcchReader : public IoStream
+{
+public:
+	// outcome of checking one hashed part of the NCCH
+	struct sSectionValidation
+	{
+		std::string name; // "exheader", "logo", "exefs", "exefs/<file>", "romfs" or "romfs/level <n>"
+		u64 size;
+		bool is_valid;
+	};
+
+	struct sSectionValidationReport
+	{
+		std::vector<sSectionValidation> sections;
+		size_t thread_num;
+		u64 total_size;
+		double seconds;
+
+		bool is_valid() const;
+		double bytes_per_second() const;
+	};
+
+	NcchReader();
+	~NcchReader();
+
+	void ImportNcch(IoStream& ncch_stream, u64 offset); // offset is where the NCCH starts in the stream
+
+	// key setup, encrypted NCCHs need one of these before their sections can be read
+	void SetFixedAesKey(const u8 key[Crypto::kAes128KeySize]);
+	void SetAesKeyX(const u8 key_x[Crypto::kAes128KeySize], const u8 secondary_key_x[Crypto::kAes128KeySize]); // pass key_x twice for key id 0
+	void SetAesKeyX(const u8 key_x[Crypto::kAes128KeySize], const u8 secondary_key_x[Crypto::kAes128KeySize], const u8 seed[Crypto::kAes128KeySize]);
+
+	const NcchHeader& GetHeader() const;
+	const ExefsHeader& GetExefsHeader() const;
+
+	// whole NCCH, decrypted
+	u64 size();
+	void read(u64 offset, size_t size, u8* out);
+
+	// offsets are relative to the start of each section
+	void ReadExheader(u64 offset, size_t size, u8* out);
+	void ReadExefs(u64 offset, size_t size, u8* out);
+	void ReadRomfs(u64 offset, size_t size, u8* out);
+
+	// checks every hash the header and ExeFS/IVFC headers hold, sections are hashed concurrently as they are decrypted
+	bool ValidateSections();
+	bool ValidateSections(sSectionValidationReport& report);
+
+private:
+	const std::string kModuleName = "NCCH_READER";
+	static const size_t kAccessDescriptorSize = 0x400; // follows the exheader and shares its key
+	static const size_t kExefsHeaderSize = 0x200;
+	static const size_t kIoBufferLen = 0x100000;
+
+	IoStream* ncch_stream_;
+	u64 ncch_offset_;
+	bool is_key_set_;
+
+	NcchHeader header_;
+	ExefsHeader exefs_header_;
+
+	std::unique_ptr<AesCtrRegionIndex> crypt_regions_; // offsets are relative to the start of the NCCH
+
+	void SetAesKeys(const u8 key[Crypto::kAes128KeySize], const u8 secondary_key[Crypto::kAes128KeySize]);
+	void AddRegion(NcchHeader::AesCtrSectionId section, u64 section_offset, u64 start, u64 end, const u8 key[Crypto::kAes128KeySize]);
+	void ReadSection(u64 section_offset, u64 section_size, u64 offset, size_t size, u8* out);
+	bool ValidateHash(u64 offset, u64 size, const u8 hash[Crypto::kSha256HashLen]);
+	bool ValidateIvfcBlocks(const IvfcHeader& ivfc, size_t level, u64 first_block, u64 block_num, const u8* expected_hashes);
+};
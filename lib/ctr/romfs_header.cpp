@@ -97,6 +97,13 @@ void RomfsHeader::DeserialiseData(const u8 * data)
 	data_offset_ = hdr->data_offset();
 }
 
+void RomfsHeader::DeserialiseData(IoStream& stream, u64 offset)
+{
+	u8 data[sizeof(sRomfsHeader)];
+	stream.read(offset, sizeof(sRomfsHeader), data);
+	DeserialiseData(data);
+}
+
 u32 RomfsHeader::GetDirHashMapTableOffset() const
 {
 	return sections_[DIR_HASHMAP_TABLE].offset();
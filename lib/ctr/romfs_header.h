@@ -1,6 +1,7 @@
 #pragma once
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
+#include <fnd/io_stream.h>
 #include <crypto/crypto.h>
 
 class RomfsHeader
@@ -61,6 +62,7 @@ public: /* public API */
 
 	// Data Deserialisation
 	void DeserialiseData(const u8* data);
+	void DeserialiseData(IoStream& stream, u64 offset);
 	u32 GetDirHashMapTableOffset() const;
 	u32 GetDirHashMapTableSize() const;
 	u32 GetDirNodeTableOffset() const;
@@ -16,7 +16,16 @@ ESCert::~ESCert()
 
 void ESCert::operator=(const ESCert & other)
 {
-	DeserialiseCert(other.GetSerialisedData());
+	// the other cert is already deserialised, so its fields are copied rather than parsed again
+	serialised_data_ = other.serialised_data_;
+	issuer_ = other.issuer_;
+	subject_ = other.subject_;
+	unique_id_ = other.unique_id_;
+	public_key_type_ = other.public_key_type_;
+	public_key_rsa4096_ = other.public_key_rsa4096_;
+	public_key_rsa2048_ = other.public_key_rsa2048_;
+	public_key_ecdsa_ = other.public_key_ecdsa_;
+	child_issuer_ = other.child_issuer_;
 }
 
 const u8* ESCert::GetSerialisedData() const
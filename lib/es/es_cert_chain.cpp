@@ -68,14 +68,23 @@ void ESCertChain::SerialiseCertChain()
 
 void ESCertChain::AddCertificate(const u8* cert_data)
 {
-	ESCert cert;
-	cert.DeserialiseCert(cert_data);
-	certs_.push_back(cert);
+	// deserialise in place, rather than into a temporary that is then copied
+	certs_.emplace_back();
+	try
+	{
+		certs_.back().DeserialiseCert(cert_data);
+	}
+	catch (...)
+	{
+		certs_.pop_back();
+		throw;
+	}
 }
 
 void ESCertChain::AddCertificate(const ESCert & cert)
 {
-	AddCertificate(cert.GetSerialisedData());
+	// the cert is already deserialised, a plain copy is enough
+	certs_.push_back(cert);
 }
 
 void ESCertChain::DeserialiseCertChain(const u8* data, size_t size)
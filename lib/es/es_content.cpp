@@ -1,3 +1,4 @@
+#include <vector>
 #include "es_content.h"
 
 ESContent::ESContent(const ESContentInfo& info, const u8 * data)
@@ -6,14 +7,38 @@ ESContent::ESContent(const ESContentInfo& info, const u8 * data)
 	SetLegacy(false);
 	is_shallow_copy_ = true;
 	data_ptr_ = data;
+	stream_ = nullptr;
+	stream_offset_ = 0;
 }
 
-ESContent::ESContent(const ESContentInfo & info, const u8 * data, bool isLegacy) 
+ESContent::ESContent(const ESContentInfo & info, const u8 * data, bool isLegacy)
 	: ESContentInfo(info)
 {
 	SetLegacy(isLegacy);
 	is_shallow_copy_ = true;
 	data_ptr_ = data;
+	stream_ = nullptr;
+	stream_offset_ = 0;
+}
+
+ESContent::ESContent(const ESContentInfo & info, IoStream & stream, u64 offset)
+	: ESContentInfo(info)
+{
+	SetLegacy(false);
+	is_shallow_copy_ = true;
+	data_ptr_ = nullptr;
+	stream_ = &stream;
+	stream_offset_ = offset;
+}
+
+ESContent::ESContent(const ESContentInfo & info, IoStream & stream, u64 offset, bool isLegacy)
+	: ESContentInfo(info)
+{
+	SetLegacy(isLegacy);
+	is_shallow_copy_ = true;
+	data_ptr_ = nullptr;
+	stream_ = &stream;
+	stream_offset_ = offset;
 }
 
 
@@ -31,6 +56,28 @@ const u8 * ESContent::GetData() const
 	return is_shallow_copy_? data_ptr_ : content_.data();
 }
 
+bool ESContent::IsStreamBacked() const
+{
+	return stream_ != nullptr;
+}
+
+void ESContent::ReadData(u64 offset, size_t size, u8 * out) const
+{
+	if (offset > GetSize() || size > GetSize() - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to read beyond end of content");
+	}
+
+	if (IsStreamBacked())
+	{
+		stream_->read(stream_offset_ + offset, size, out);
+	}
+	else
+	{
+		memcpy(out, GetData() + offset, size);
+	}
+}
+
 bool ESContent::IsContentEnabled() const
 {
 	return is_content_enabled_;
@@ -41,8 +88,43 @@ void ESContent::SetupAesIV(u8 iv[Crypto::kAesBlockSize]) const
 	ESCrypto::SetupContentAesIv(GetContentIndex(), iv);
 }
 
+void ESContent::ReadDecryptedData(u64 offset, size_t size, const AesKeySchedule& key, u8* out) const
+{
+	if (offset % Crypto::kAesBlockSize != 0 || size % Crypto::kAesBlockSize != 0)
+	{
+		throw ProjectSnakeException(kModuleName, "Encrypted content reads must be block aligned");
+	}
+
+	// cbc only chains through the previous ciphertext block, so it comes in with the same read
+	u8 iv[Crypto::kAesBlockSize];
+	if (offset == 0)
+	{
+		SetupAesIV(out);
+		ReadData(0, size, out + Crypto::kAesBlockSize);
+	}
+	else
+	{
+		ReadData(offset - Crypto::kAesBlockSize, size + Crypto::kAesBlockSize, out);
+	}
+	memcpy(iv, out, Crypto::kAesBlockSize);
+
+	Crypto::AesCbcDecrypt(out + Crypto::kAesBlockSize, size, key, iv, out + Crypto::kAesBlockSize);
+}
+
 void ESContent::EncryptContent(const u8 key[Crypto::kAes128KeySize])
 {
+	EncryptContent(AesKeySchedule(key, AesKeySchedule::USAGE_ENCRYPT));
+}
+
+void ESContent::EncryptContent(const AesKeySchedule& key)
+{
+	// stream backed content is read in blocks and stored in the allocation
+	if (IsStreamBacked())
+	{
+		CryptStreamToInternalBuffer(key, true);
+		return;
+	}
+
 	// init vector
 	u8 iv[Crypto::kAesBlockSize];
 	SetupAesIV(iv);
@@ -65,6 +147,18 @@ void ESContent::EncryptContent(const u8 key[Crypto::kAes128KeySize])
 
 void ESContent::DecryptContent(const u8 key[Crypto::kAes128KeySize])
 {
+	DecryptContent(AesKeySchedule(key, AesKeySchedule::USAGE_DECRYPT));
+}
+
+void ESContent::DecryptContent(const AesKeySchedule& key)
+{
+	// stream backed content is read in blocks and stored in the allocation
+	if (IsStreamBacked())
+	{
+		CryptStreamToInternalBuffer(key, false);
+		return;
+	}
+
 	// init vector
 	u8 iv[Crypto::kAesBlockSize];
 	SetupAesIV(iv);
@@ -74,28 +168,21 @@ void ESContent::DecryptContent(const u8 key[Crypto::kAes128KeySize])
 	if (is_shallow_copy_ == true)
 	{
 		content_.alloc(GetSize());
-		Crypto::AesCbcDecrypt(data_ptr_, GetSize(), key, iv, content_.data());
+		Crypto::AesCbcDecryptParallel(data_ptr_, GetSize(), key, iv, content_.data());
 		is_shallow_copy_ = false;
 		data_ptr_ = nullptr;
 	}
 	// otherwise overwrite the existing data
 	else
 	{
-		Crypto::AesCbcDecrypt(content_.data(), GetSize(), key, iv, content_.data());
+		Crypto::AesCbcDecryptParallel(content_.data(), GetSize(), key, iv, content_.data());
 	}
 }
 
 bool ESContent::ValidateContentHash() const
 {
 	u8 hash[Crypto::kSha256HashLen];
-	if (IsSha1Hash())
-	{
-		Crypto::Sha1(GetData(), GetSize(), hash);
-	}
-	else
-	{
-		Crypto::Sha256(GetData(), GetSize(), hash);
-	}
+	HashContent(hash);
 
 	return ValidateHash(hash);
 }
@@ -103,16 +190,14 @@ bool ESContent::ValidateContentHash() const
 void ESContent::UpdateContentHash()
 {
 	u8 hash[Crypto::kSha256HashLen];
-	if (IsSha1Hash())
-	{
-		Crypto::Sha1(GetData(), GetSize(), hash);
-		SetHash(hash, true);
-	}
-	else
-	{
-		Crypto::Sha256(GetData(), GetSize(), hash);
-		SetHash(hash, false);
-	}
+	HashContent(hash);
+
+	SetHash(hash, IsSha1Hash());
+}
+
+void ESContent::SetContentHash(const u8 * hash)
+{
+	SetHash(hash, IsSha1Hash());
 }
 
 void ESContent::CopyToInternalBuffer()
@@ -121,4 +206,68 @@ void ESContent::CopyToInternalBuffer()
 	memcpy(content_.data(), data_ptr_, content_.size());
 	is_shallow_copy_ = false;
 	data_ptr_ = nullptr;
-}
\ No newline at end of file
+}
+
+void ESContent::CryptStreamToInternalBuffer(const AesKeySchedule& key, bool encrypt)
+{
+	if (content_.alloc(GetSize()) != content_.ERR_NONE)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to allocate memory for content");
+	}
+
+	// the iv is carried between blocks by the cbc encrypt function
+	u8 iv[Crypto::kAesBlockSize];
+	SetupAesIV(iv);
+
+	for (u64 pos = 0; pos < GetSize(); pos += kIoBufferLen)
+	{
+		size_t block_size = (GetSize() - pos) < kIoBufferLen ? (size_t)(GetSize() - pos) : kIoBufferLen;
+		stream_->read(stream_offset_ + pos, block_size, content_.data() + pos);
+		if (encrypt)
+		{
+			Crypto::AesCbcEncrypt(content_.data() + pos, block_size, key, iv, content_.data() + pos);
+		}
+	}
+
+	// decryption isn't chained, so it is done once everything is read and split across threads
+	if (encrypt == false)
+	{
+		Crypto::AesCbcDecryptParallel(content_.data(), GetSize(), key, iv, content_.data());
+	}
+
+	is_shallow_copy_ = false;
+	data_ptr_ = nullptr;
+	stream_ = nullptr;
+	stream_offset_ = 0;
+}
+
+void ESContent::HashContent(u8* hash) const
+{
+	// in memory content is hashed in one pass
+	if (IsStreamBacked() == false)
+	{
+		if (IsSha1Hash())
+		{
+			Crypto::Sha1(GetData(), GetSize(), hash);
+		}
+		else
+		{
+			Crypto::Sha256(GetData(), GetSize(), hash);
+		}
+		return;
+	}
+
+	// stream backed content is hashed in blocks
+	std::vector<u8> block(kIoBufferLen);
+	sHashContext hash_ctx;
+	hash_ctx.init(IsSha1Hash());
+
+	for (u64 pos = 0; pos < GetSize(); pos += kIoBufferLen)
+	{
+		size_t block_size = (GetSize() - pos) < kIoBufferLen ? (size_t)(GetSize() - pos) : kIoBufferLen;
+		stream_->read(stream_offset_ + pos, block_size, block.data());
+		hash_ctx.update(block.data(), block_size);
+	}
+
+	hash_ctx.final(hash);
+}
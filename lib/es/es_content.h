@@ -1,15 +1,33 @@
 #pragma once
+#include <fnd/io_stream.h>
+#include <crypto/aes_key_schedule.h>
 #include <es/es_content_info.h>
 
 class ESContent : public ESContentInfo
 {
 public:
+	// incremental content hash, sha1 or sha256 depending on the content
+	struct sHashContext
+	{
+		bool is_sha1;
+		Crypto::sSha1Context sha1;
+		Crypto::sSha256Context sha256;
+
+		void init(bool sha1_hash) { is_sha1 = sha1_hash; is_sha1 ? Crypto::Sha1Init(sha1) : Crypto::Sha256Init(sha256); }
+		void update(const u8* data, size_t size) { is_sha1 ? Crypto::Sha1Update(sha1, data, size) : Crypto::Sha256Update(sha256, data, size); }
+		void final(u8* hash) { is_sha1 ? Crypto::Sha1Final(sha1, hash) : Crypto::Sha256Final(sha256, hash); }
+	};
+
 	ESContent(const ESContentInfo& info, const u8* data);
 	ESContent(const ESContentInfo& info, const u8* data, bool isLegacy);
+	ESContent(const ESContentInfo& info, IoStream& stream, u64 offset);
+	ESContent(const ESContentInfo& info, IoStream& stream, u64 offset, bool isLegacy);
 	~ESContent();
 
 	// get access to data
-	const u8* GetData() const;
+	const u8* GetData() const; // nullptr when the content is backed by a stream
+	bool IsStreamBacked() const;
+	void ReadData(u64 offset, size_t size, u8* out) const;
 
 	// ticket enabled?
 	void EnableContent(bool isEnabled);
@@ -17,19 +35,35 @@ public:
 
 	// encryption
 	void SetupAesIV(u8 iv[Crypto::kAesBlockSize]) const;
+	// decrypts [offset, offset + size) of the encrypted content, offset and size must be multiples of the aes block size.
+	// out must hold Crypto::kAesBlockSize + size bytes: the first block receives the iv (the content iv at offset 0, otherwise the
+	// ciphertext block before offset, fetched in the same read), and the plaintext follows it
+	void ReadDecryptedData(u64 offset, size_t size, const AesKeySchedule& key, u8* out) const;
 	void EncryptContent(const u8 key[Crypto::kAes128KeySize]);
+	void EncryptContent(const AesKeySchedule& key);
 	void DecryptContent(const u8 key[Crypto::kAes128KeySize]);
+	void DecryptContent(const AesKeySchedule& key);
 
 	// hash related
 	void UpdateContentHash();
+	void SetContentHash(const u8* hash); // for callers that hash the content while processing it
 	bool ValidateContentHash() const;
 private:
+	const std::string kModuleName = "ES_CONTENT";
+	static const size_t kIoBufferLen = 0x100000;
+
 	bool is_content_enabled_;
 
 	bool is_shallow_copy_;
 	const u8* data_ptr_;
 	MemoryBlob content_;
 
+	// stream backed content, data is only read on demand
+	IoStream* stream_;
+	u64 stream_offset_;
+
 	void CopyToInternalBuffer();
+	void CryptStreamToInternalBuffer(const AesKeySchedule& key, bool encrypt);
+	void HashContent(u8* hash) const;
 };
 
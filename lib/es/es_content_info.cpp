@@ -69,12 +69,13 @@ void ESContentInfo::SetSize(u64 size)
 
 void ESContentInfo::SetHash(const u8 * hash, bool is_sha1)
 {
+	// content without a hash yet (e.g. it is hashed while being written) gets a zeroed one
+	memset(hash_, 0, Crypto::kSha256HashLen);
 	if (hash == nullptr)
 	{
 		return;
 	}
 
-	memset(hash_, 0, Crypto::kSha256HashLen);
 	memcpy(hash_, hash, is_sha1 ? Crypto::kSha1HashLen : Crypto::kSha256HashLen);
 }
 
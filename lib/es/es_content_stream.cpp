@@ -0,0 +1,104 @@
+#include <iterator>
+#include "es_content_stream.h"
+
+ESContentStream::ESContentStream(const ESContent& content, const AesKeySchedule& key) :
+	ESContentStream(content, key, 0)
+{
+}
+
+ESContentStream::ESContentStream(const ESContent& content, const AesKeySchedule& key, size_t cache_chunk_num) :
+	content_(content),
+	key_(key),
+	is_encrypted_(content.IsFlagSet(ESContent::ES_CONTENT_FLAG_ENCRYPTED)),
+	buffer_(),
+	cache_chunk_num_(cache_chunk_num)
+{
+	if (is_encrypted_ && content_.GetSize() % Crypto::kAesBlockSize != 0)
+	{
+		throw ProjectSnakeException(kModuleName, "Encrypted content size is not block aligned");
+	}
+
+	// without a cache every read decrypts through one reusable chunk buffer
+	if (cache_chunk_num_ == 0)
+	{
+		buffer_.resize(kChunkSize + Crypto::kAesBlockSize);
+	}
+}
+
+ESContentStream::~ESContentStream()
+{
+}
+
+u64 ESContentStream::size()
+{
+	return content_.GetSize();
+}
+
+void ESContentStream::read(u64 offset, size_t size, u8* out)
+{
+	if (offset > content_.GetSize() || size > content_.GetSize() - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to read beyond end of content");
+	}
+
+	if (is_encrypted_ == false)
+	{
+		content_.ReadData(offset, size, out);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// work through the chunks the read covers, only the whole blocks inside the read range are decrypted
+	size_t copy_size = 0;
+	for (u64 pos = offset; pos < offset + size; pos += copy_size)
+	{
+		u64 chunk_start = pos - (pos % kChunkSize);
+		size_t chunk_offset = (size_t)(pos - chunk_start);
+		copy_size = (kChunkSize - chunk_offset) < (offset + size - pos) ? (kChunkSize - chunk_offset) : (size_t)(offset + size - pos);
+
+		if (cache_chunk_num_ > 0)
+		{
+			memcpy(out + (pos - offset), GetChunk(chunk_start / kChunkSize) + chunk_offset, copy_size);
+		}
+		else
+		{
+			u64 block_start = pos & ~(u64)(Crypto::kAesBlockSize - 1);
+			u64 block_end = align(pos + copy_size, Crypto::kAesBlockSize);
+			content_.ReadDecryptedData(block_start, (size_t)(block_end - block_start), key_, buffer_.data());
+			memcpy(out + (pos - offset), buffer_.data() + Crypto::kAesBlockSize + (pos - block_start), copy_size);
+		}
+	}
+}
+
+const u8* ESContentStream::GetChunk(u64 index)
+{
+	auto itr = cache_index_.find(index);
+	if (itr != cache_index_.end())
+	{
+		cache_.splice(cache_.begin(), cache_, itr->second);
+		return itr->second->data.data() + Crypto::kAesBlockSize;
+	}
+
+	// recycle the least recently used chunk once the cache is full
+	if (cache_.size() >= cache_chunk_num_)
+	{
+		cache_index_.erase(cache_.back().index);
+		cache_.splice(cache_.begin(), cache_, std::prev(cache_.end()));
+	}
+	else
+	{
+		cache_.push_front(sCachedChunk());
+	}
+
+	sCachedChunk& chunk = cache_.front();
+	chunk.index = index;
+	chunk.data.resize(kChunkSize + Crypto::kAesBlockSize);
+
+	u64 chunk_start = index * kChunkSize;
+	size_t chunk_size = (content_.GetSize() - chunk_start) < kChunkSize ? (size_t)(content_.GetSize() - chunk_start) : kChunkSize;
+	content_.ReadDecryptedData(chunk_start, chunk_size, key_, chunk.data.data());
+	cache_index_[index] = cache_.begin();
+
+	return chunk.data.data() + Crypto::kAesBlockSize;
+}
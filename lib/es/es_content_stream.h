@@ -0,0 +1,52 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <fnd/io_stream.h>
+#include <crypto/aes_key_schedule.h>
+#include <es/es_content.h>
+
+/*
+ Decrypted, random access view of a content as stored in a CIA.
+ CBC block i only depends on ciphertext block i - 1 (or the content iv), so
+ a read decrypts just the blocks it covers. Decrypted chunks can optionally
+ be kept in a small LRU cache for parsers that revisit the same headers.
+ Unencrypted contents are passed through. The content must still hold its
+ encrypted data and must outlive the stream. Reads are thread safe.
+*/
+class ESContentStream : public IoStream
+{
+public:
+	static const size_t kChunkSize = 0x10000;
+
+	ESContentStream(const ESContent& content, const AesKeySchedule& key);
+	ESContentStream(const ESContent& content, const AesKeySchedule& key, size_t cache_chunk_num);
+	~ESContentStream();
+
+	u64 size();
+	void read(u64 offset, size_t size, u8* out);
+
+private:
+	const std::string kModuleName = "ES_CONTENT_STREAM";
+
+	struct sCachedChunk
+	{
+		u64 index;
+		std::vector<u8> data;
+	};
+
+	const ESContent& content_;
+	AesKeySchedule key_;
+	bool is_encrypted_;
+
+	std::mutex mutex_;
+	std::vector<u8> buffer_; // ciphertext of one chunk plus the block before it
+
+	// front is most recently used
+	size_t cache_chunk_num_;
+	std::list<sCachedChunk> cache_;
+	std::unordered_map<u64, std::list<sCachedChunk>::iterator> cache_index_;
+
+	const u8* GetChunk(u64 index);
+};
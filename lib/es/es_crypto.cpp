@@ -1,6 +1,7 @@
 #include <cstdio>
 #include <cstring>
 #include "es_crypto.h"
+#include "es_signature_cache.h"
 
 int ESCrypto::GenerateSignature(ESSignType type, const uint8_t * hash, const Crypto::sRsa2048Key & private_key, uint8_t * signature)
 {
@@ -54,20 +55,42 @@ int ESCrypto::RsaSign(ESSignType type, const uint8_t * hash, const Crypto::sRsa2
 
 int ESCrypto::RsaVerify(const uint8_t * hash, const Crypto::sRsa4096Key & public_key, const uint8_t * signature)
 {
-	if (!IsSignRsa4096(get_sign_type(signature)))
+	ESSignType type = get_sign_type(signature);
+	if (!IsSignRsa4096(type))
 	{
 		return 1;
 	}
-	return Crypto::RsaVerify(public_key, GetHashType(get_sign_type(signature)), hash, signature + 4);
+
+	uint8_t digest[ESSignatureCache::kDigestLen];
+	ESSignatureCache::MakeDigest(public_key.modulus, Crypto::kRsa4096Size, public_key.public_exponent, Crypto::kRsaPublicExponentSize, hash, GetHashSize(type), signature, GetSignatureSize(type), digest);
+
+	int ret;
+	if (!ESSignatureCache::Global().Lookup(digest, ret))
+	{
+		ret = Crypto::RsaVerify(public_key, GetHashType(type), hash, signature + 4);
+		ESSignatureCache::Global().Insert(digest, ret);
+	}
+	return ret;
 }
 
 int ESCrypto::RsaVerify(const uint8_t * hash, const Crypto::sRsa2048Key & public_key, const uint8_t * signature)
 {
-	if (!IsSignRsa2048(get_sign_type(signature)))
+	ESSignType type = get_sign_type(signature);
+	if (!IsSignRsa2048(type))
 	{
 		return 1;
 	}
-	return Crypto::RsaVerify(public_key, GetHashType(get_sign_type(signature)), hash, signature + 4);
+
+	uint8_t digest[ESSignatureCache::kDigestLen];
+	ESSignatureCache::MakeDigest(public_key.modulus, Crypto::kRsa2048Size, public_key.public_exponent, Crypto::kRsaPublicExponentSize, hash, GetHashSize(type), signature, GetSignatureSize(type), digest);
+
+	int ret;
+	if (!ESSignatureCache::Global().Lookup(digest, ret))
+	{
+		ret = Crypto::RsaVerify(public_key, GetHashType(type), hash, signature + 4);
+		ESSignatureCache::Global().Insert(digest, ret);
+	}
+	return ret;
 }
 
 ESCrypto::ESSignType ESCrypto::GetSignatureType(const void* signed_binary)
@@ -172,3 +195,8 @@ Crypto::HashType ESCrypto::GetHashType(ESSignType type)
 	return IsSignHashSha1(type) ? Crypto::HASH_SHA1 : Crypto::HASH_SHA256;
 }
 
+size_t ESCrypto::GetHashSize(ESSignType type)
+{
+	return IsSignHashSha1(type) ? Crypto::kSha1HashLen : Crypto::kSha256HashLen;
+}
+
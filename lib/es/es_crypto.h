@@ -49,6 +49,7 @@ private:
 	static inline void set_sign_type(ESSignType type, void* pre_signing) { *((uint32_t*)(pre_signing)) = be_word(type); }
 
 	static Crypto::HashType GetHashType(ESSignType type);
+	static size_t GetHashSize(ESSignType type);
 
 	static int RsaSign(ESSignType type, const uint8_t* hash, const Crypto::sRsa4096Key& private_key, uint8_t* signature);
 	static int RsaSign(ESSignType type, const uint8_t* hash, const Crypto::sRsa2048Key& private_key, uint8_t* signature);
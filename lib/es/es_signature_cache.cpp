@@ -0,0 +1,118 @@
+#include "es_signature_cache.h"
+
+ESSignatureCache::ESSignatureCache(size_t capacity) :
+	capacity_(capacity),
+	hit_num_(0),
+	miss_num_(0)
+{
+}
+
+ESSignatureCache& ESSignatureCache::Global()
+{
+	static ESSignatureCache cache(kDefaultCapacity);
+	return cache;
+}
+
+void ESSignatureCache::MakeDigest(const uint8_t* modulus, size_t modulus_size, const uint8_t* public_exponent, size_t exponent_size, const uint8_t* hash, size_t hash_size, const uint8_t* signature, size_t signature_size, uint8_t digest[kDigestLen])
+{
+	// the sizes are mixed in too, so fields of different lengths can't run into each other
+	uint32_t sizes[4] = { be_word((uint32_t)modulus_size), be_word((uint32_t)exponent_size), be_word((uint32_t)hash_size), be_word((uint32_t)signature_size) };
+
+	Crypto::sSha256Context ctx;
+	Crypto::Sha256Init(ctx);
+	Crypto::Sha256Update(ctx, (const uint8_t*)sizes, sizeof(sizes));
+	Crypto::Sha256Update(ctx, modulus, modulus_size);
+	Crypto::Sha256Update(ctx, public_exponent, exponent_size);
+	Crypto::Sha256Update(ctx, hash, hash_size);
+	Crypto::Sha256Update(ctx, signature, signature_size);
+	Crypto::Sha256Final(ctx, digest);
+}
+
+bool ESSignatureCache::Lookup(const uint8_t digest[kDigestLen], int& result)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto itr = index_.find(std::string((const char*)digest, kDigestLen));
+	if (itr == index_.end())
+	{
+		miss_num_++;
+		return false;
+	}
+
+	entries_.splice(entries_.begin(), entries_, itr->second);
+	result = itr->second->second;
+	hit_num_++;
+	return true;
+}
+
+void ESSignatureCache::Insert(const uint8_t digest[kDigestLen], int result)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (capacity_ == 0)
+	{
+		return;
+	}
+
+	std::string key((const char*)digest, kDigestLen);
+	auto itr = index_.find(key);
+	if (itr != index_.end())
+	{
+		itr->second->second = result;
+		entries_.splice(entries_.begin(), entries_, itr->second);
+		return;
+	}
+
+	entries_.push_front(std::make_pair(key, result));
+	index_[key] = entries_.begin();
+	Evict();
+}
+
+void ESSignatureCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.clear();
+	index_.clear();
+	hit_num_ = 0;
+	miss_num_ = 0;
+}
+
+void ESSignatureCache::SetCapacity(size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	capacity_ = capacity;
+	Evict();
+}
+
+size_t ESSignatureCache::GetCapacity() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return capacity_;
+}
+
+size_t ESSignatureCache::GetSize() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return entries_.size();
+}
+
+uint64_t ESSignatureCache::GetHitNum() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return hit_num_;
+}
+
+uint64_t ESSignatureCache::GetMissNum() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return miss_num_;
+}
+
+void ESSignatureCache::Evict()
+{
+	while (entries_.size() > capacity_)
+	{
+		index_.erase(entries_.back().first);
+		entries_.pop_back();
+	}
+}
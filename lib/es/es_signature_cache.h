@@ -0,0 +1,52 @@
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <string>
+#include <mutex>
+#include <fnd/types.h>
+#include <crypto/crypto.h>
+
+/*
+ Remembers the outcome of signature verifications, keyed by a SHA-256 digest
+ of (public key modulus and exponent, message hash, signature). The same CA/XS/CP certificates
+ sign every title, so repeated scans only pay for each distinct signature
+ once. Entries are evicted least recently used first. Thread-safe.
+*/
+class ESSignatureCache
+{
+public:
+	static const size_t kDigestLen = Crypto::kSha256HashLen;
+	static const size_t kDefaultCapacity = 0x4000;
+
+	ESSignatureCache(size_t capacity);
+
+	// shared by ESCrypto signature verification
+	static ESSignatureCache& Global();
+
+	static void MakeDigest(const uint8_t* modulus, size_t modulus_size, const uint8_t* public_exponent, size_t exponent_size, const uint8_t* hash, size_t hash_size, const uint8_t* signature, size_t signature_size, uint8_t digest[kDigestLen]);
+
+	bool Lookup(const uint8_t digest[kDigestLen], int& result);
+	void Insert(const uint8_t digest[kDigestLen], int result);
+	void Clear();
+
+	// capacity 0 disables the cache
+	void SetCapacity(size_t capacity);
+	size_t GetCapacity() const;
+	size_t GetSize() const;
+	uint64_t GetHitNum() const;
+	uint64_t GetMissNum() const;
+
+private:
+	typedef std::list<std::pair<std::string, int>> EntryList;
+
+	mutable std::mutex mutex_;
+	size_t capacity_;
+	uint64_t hit_num_;
+	uint64_t miss_num_;
+
+	// front is most recently used
+	EntryList entries_;
+	std::unordered_map<std::string, EntryList::iterator> index_;
+
+	void Evict();
+};
@@ -2,8 +2,10 @@
 #include "es_crypto.h"
 
 
-ESTmd::ESTmd()
+ESTmd::ESTmd() :
+	serialised_data_()
 {
+	ClearDeserialisedVariables();
 }
 
 
@@ -277,7 +279,7 @@ void ESTmd::ClearDeserialisedVariables()
 	system_version_ = 0;
 	title_id_ = 0;
 	title_type_ = (ESTitleType)0;
-	company_code_ = "\0\0";
+	company_code_ = std::string(kCompanyCodeLen, '\0');
 	memset(platform_reserved_data_, 0, kPlatformReservedDataSize);
 	access_rights_ = 0;
 	title_version_ = 0;
@@ -286,6 +288,26 @@ void ESTmd::ClearDeserialisedVariables()
 	content_list_.clear();
 }
 
+size_t ESTmd::PredictSerialisedDataSize() const
+{
+	return PredictSerialisedDataSize(kDefaultVersion);
+}
+
+size_t ESTmd::PredictSerialisedDataSize(ESTmdFormatVersion format) const
+{
+	// matches the sign types and layouts SerialiseTmd() uses
+	if (format == ES_TMD_VER_0)
+	{
+		return ESCrypto::GetSignatureSize(ESCrypto::ES_SIGN_RSA2048_SHA1) + sizeof(sTitleMetadataBody_v0) + sizeof(sContentInfo_v0) * content_list_.size();
+	}
+	else if (format == ES_TMD_VER_1)
+	{
+		return ESCrypto::GetSignatureSize(ESCrypto::ES_SIGN_RSA2048_SHA256) + sizeof(sTitleMetadataBody_v1) + sizeof(sInfoRecord) * kInfoRecordNum + sizeof(sContentInfo_v1) * content_list_.size();
+	}
+
+	throw ProjectSnakeException(kModuleName, "Unsupported TMD version: " + std::to_string(format));
+}
+
 void ESTmd::SerialiseTmd(const Crypto::sRsa2048Key& private_key)
 {
 	SerialiseTmd(private_key, kDefaultVersion);
@@ -426,6 +448,12 @@ void ESTmd::AddContent(const ESContentInfo& content_info)
 	content_num_++;
 }
 
+void ESTmd::ClearContentList()
+{
+	content_list_.clear();
+	content_num_ = 0;
+}
+
 void ESTmd::DeserialiseTmd(const u8* tmd_data, size_t size)
 {
 	ClearDeserialisedVariables();
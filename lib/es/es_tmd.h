@@ -39,6 +39,10 @@ public:
 	const u8* GetSerialisedData() const;
 	size_t GetSerialisedDataSize() const;
 
+	// size SerialiseTmd() will produce for the contents added so far, so a container can be laid out before the tmd is signed
+	size_t PredictSerialisedDataSize() const;
+	size_t PredictSerialisedDataSize(ESTmdFormatVersion format) const;
+
 	// Tmd Serialisation
 	void SerialiseTmd(const Crypto::sRsa2048Key& private_key);
 	void SerialiseTmd(const Crypto::sRsa2048Key& private_key, ESTmdFormatVersion format);
@@ -56,6 +60,7 @@ public:
 	void SetTitleVersion(u16 title_version);
 	void SetBootContentIndex(u16 index);
 	void AddContent(const ESContentInfo& content_info);
+	void ClearContentList();
 
 	// Ticket Deserialisation
 	void DeserialiseTmd(const u8* tmd_data, size_t size);
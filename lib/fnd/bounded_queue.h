@@ -0,0 +1,69 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ Fixed capacity FIFO for handing work between threads.
+ push() blocks while the queue is full, pop() blocks while it is empty.
+ After close(), push() fails and pop() fails once the queue has drained.
+*/
+template <class T>
+class BoundedQueue
+{
+public:
+	BoundedQueue(size_t capacity) :
+		capacity_(capacity),
+		is_closed_(false)
+	{
+	}
+
+	bool push(const T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		not_full_.wait(lock, [this] { return is_closed_ || queue_.size() < capacity_; });
+		if (is_closed_)
+		{
+			return false;
+		}
+
+		queue_.push_back(item);
+		not_empty_.notify_one();
+		return true;
+	}
+
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		not_empty_.wait(lock, [this] { return is_closed_ || queue_.empty() == false; });
+		if (queue_.empty())
+		{
+			return false;
+		}
+
+		item = queue_.front();
+		queue_.pop_front();
+		not_full_.notify_one();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_closed_ = true;
+		not_full_.notify_all();
+		not_empty_.notify_all();
+	}
+
+private:
+	// non-copyable, waiting threads hold references to the members
+	BoundedQueue(const BoundedQueue& other) = delete;
+	void operator=(const BoundedQueue& other) = delete;
+
+	size_t capacity_;
+	bool is_closed_;
+	std::deque<T> queue_;
+	std::mutex mutex_;
+	std::condition_variable not_full_;
+	std::condition_variable not_empty_;
+};
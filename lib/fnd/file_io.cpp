@@ -38,5 +38,12 @@ void FileIO::ReadFile(const std::string& path, MemoryBlob & blob)
 
 void FileIO::WriteFile(const std::string& path, const MemoryBlob & blob)
 {
+	WriteFile(path, blob, OutputFile::SYNC_NONE);
+}
 
+void FileIO::WriteFile(const std::string& path, const MemoryBlob & blob, OutputFile::SyncPolicy sync_policy)
+{
+	OutputFile file(path, blob.size(), sync_policy);
+	file.write(blob.data(), blob.size());
+	file.commit();
 }
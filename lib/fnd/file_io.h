@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <fnd/memory_blob.h>
+#include <fnd/output_file.h>
 
 class FileIO
 {
@@ -8,6 +9,7 @@ public:
 	static void ReadFile(const std::string& path, MemoryBlob& blob);
 	//static void ReadFile(const char* path, MemoryBlob& blob, size_t offset, size_t size);
 	static void WriteFile(const std::string& path, const MemoryBlob& blob);
+	static void WriteFile(const std::string& path, const MemoryBlob& blob, OutputFile::SyncPolicy sync_policy);
 	//static void WriteFile(const char* path, const MemoryBlob& blob, size_t offset, size_t size);
 private:
 	
@@ -0,0 +1,155 @@
+#include <cstring>
+#include "file_stream.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+FileStream::FileStream() :
+	path_(),
+	is_open_(false),
+	size_(0),
+#ifdef _WIN32
+	file_handle_(INVALID_HANDLE_VALUE)
+#else
+	fd_(-1)
+#endif
+{
+}
+
+FileStream::FileStream(const std::string & path) :
+	FileStream()
+{
+	open(path);
+}
+
+FileStream::~FileStream()
+{
+	close();
+}
+
+void FileStream::open(const std::string & path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to open \"" + path + "\"");
+	}
+
+	LARGE_INTEGER filesz;
+	if (GetFileSizeEx(file, &filesz) == FALSE)
+	{
+		CloseHandle(file);
+		throw ProjectSnakeException(kModuleName, "Failed to determine size of \"" + path + "\"");
+	}
+
+	file_handle_ = file;
+	size_ = (u64)filesz.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to open \"" + path + "\"");
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		throw ProjectSnakeException(kModuleName, "Failed to determine size of \"" + path + "\"");
+	}
+
+	fd_ = fd;
+	size_ = (u64)st.st_size;
+#endif
+
+	path_ = path;
+	is_open_ = true;
+}
+
+void FileStream::close()
+{
+	if (is_open_ == false)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	CloseHandle(file_handle_);
+	file_handle_ = INVALID_HANDLE_VALUE;
+#else
+	::close(fd_);
+	fd_ = -1;
+#endif
+
+	path_.clear();
+	is_open_ = false;
+	size_ = 0;
+}
+
+u64 FileStream::size()
+{
+	return size_;
+}
+
+void FileStream::read(u64 offset, size_t size, u8 * out)
+{
+	if (is_open_ == false)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to read from a closed stream");
+	}
+
+	if (offset > size_ || size > size_ - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to read beyond end of \"" + path_ + "\"");
+	}
+
+	while (size > 0)
+	{
+		size_t read_size = size < kMaxReadLen ? size : kMaxReadLen;
+		size_t read_len = 0;
+
+#ifdef _WIN32
+		OVERLAPPED ov;
+		memset(&ov, 0, sizeof(OVERLAPPED));
+		ov.Offset = (DWORD)(offset & 0xffffffff);
+		ov.OffsetHigh = (DWORD)(offset >> 32);
+
+		DWORD len = 0;
+		if (ReadFile(file_handle_, out, (DWORD)read_size, &len, &ov) == FALSE)
+		{
+			throw ProjectSnakeException(kModuleName, "Failed to read from \"" + path_ + "\"");
+		}
+		read_len = len;
+#else
+		ssize_t len = pread(fd_, out, read_size, (off_t)offset);
+		if (len < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			throw ProjectSnakeException(kModuleName, "Failed to read from \"" + path_ + "\"");
+		}
+		read_len = (size_t)len;
+#endif
+
+		// the file was truncated after it was opened
+		if (read_len == 0)
+		{
+			throw ProjectSnakeException(kModuleName, "Unexpected end of file \"" + path_ + "\"");
+		}
+
+		offset += read_len;
+		out += read_len;
+		size -= read_len;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <fnd/io_stream.h>
+
+/*
+ IoStream over a file on disk, read with pread()/overlapped ReadFile().
+ Only the bytes requested are read, so arbitrarily large files can be
+ processed with bounded buffers. Reads are thread safe.
+*/
+class FileStream : public IoStream
+{
+public:
+	FileStream();
+	FileStream(const std::string& path);
+	~FileStream();
+
+	void open(const std::string& path);
+	void close();
+	inline bool is_open() const { return is_open_; }
+
+	u64 size();
+	void read(u64 offset, size_t size, u8* out);
+private:
+	const std::string kModuleName = "FILE_STREAM";
+	static const size_t kMaxReadLen = 0x40000000;
+
+	// non-copyable, the file handle is owned by this object
+	FileStream(const FileStream& other) = delete;
+	void operator=(const FileStream& other) = delete;
+
+	std::string path_;
+	bool is_open_;
+	u64 size_;
+#ifdef _WIN32
+	void* file_handle_;
+#else
+	int fd_;
+#endif
+};
@@ -0,0 +1,16 @@
+#pragma once
+#include <fnd/types.h>
+
+/*
+ Positional (pread style) read interface.
+ Reads never move a shared file position, so a single stream may be read
+ from multiple threads provided the implementation says so.
+*/
+class IoStream
+{
+public:
+	virtual ~IoStream() {}
+
+	virtual u64 size() = 0;
+	virtual void read(u64 offset, size_t size, u8* out) = 0;
+};
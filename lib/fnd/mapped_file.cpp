@@ -0,0 +1,196 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+// windows has no madvise equivalent that is worth the trouble, hints are ignored
+enum
+{
+	ADVICE_SEQUENTIAL,
+	ADVICE_WILLNEED,
+	ADVICE_DONTNEED,
+};
+#else
+enum
+{
+	ADVICE_SEQUENTIAL = MADV_SEQUENTIAL,
+	ADVICE_WILLNEED = MADV_WILLNEED,
+	ADVICE_DONTNEED = MADV_DONTNEED,
+};
+#endif
+
+MappedFile::MappedFile() :
+	is_open_(false),
+	data_(nullptr),
+	size_(0),
+#ifdef _WIN32
+	file_handle_(INVALID_HANDLE_VALUE),
+	map_handle_(nullptr)
+#else
+	fd_(-1)
+#endif
+{
+}
+
+MappedFile::MappedFile(const std::string & path) :
+	MappedFile()
+{
+	open(path);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+void MappedFile::open(const std::string & path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to open \"" + path + "\"");
+	}
+
+	LARGE_INTEGER filesz;
+	if (GetFileSizeEx(file, &filesz) == FALSE || (u64)filesz.QuadPart > (u64)SIZE_MAX)
+	{
+		CloseHandle(file);
+		throw ProjectSnakeException(kModuleName, "Failed to determine size of \"" + path + "\"");
+	}
+
+	HANDLE map = nullptr;
+	const byte_t* data = nullptr;
+	if (filesz.QuadPart > 0)
+	{
+		map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (map == nullptr)
+		{
+			CloseHandle(file);
+			throw ProjectSnakeException(kModuleName, "Failed to map \"" + path + "\"");
+		}
+
+		data = (const byte_t*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+		if (data == nullptr)
+		{
+			CloseHandle(map);
+			CloseHandle(file);
+			throw ProjectSnakeException(kModuleName, "Failed to map \"" + path + "\"");
+		}
+	}
+
+	file_handle_ = file;
+	map_handle_ = map;
+	data_ = data;
+	size_ = (size_t)filesz.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to open \"" + path + "\"");
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (u64)st.st_size > (u64)SIZE_MAX)
+	{
+		::close(fd);
+		throw ProjectSnakeException(kModuleName, "Failed to determine size of \"" + path + "\"");
+	}
+
+	// mmap() rejects zero length mappings, an empty file is represented with a null pointer
+	const byte_t* data = nullptr;
+	if (st.st_size > 0)
+	{
+		void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED)
+		{
+			::close(fd);
+			throw ProjectSnakeException(kModuleName, "Failed to map \"" + path + "\"");
+		}
+		data = (const byte_t*)map;
+	}
+
+	fd_ = fd;
+	data_ = data;
+	size_ = (size_t)st.st_size;
+#endif
+
+	is_open_ = true;
+}
+
+void MappedFile::close()
+{
+	if (is_open_ == false)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	if (data_ != nullptr)
+	{
+		UnmapViewOfFile(data_);
+	}
+	if (map_handle_ != nullptr)
+	{
+		CloseHandle(map_handle_);
+	}
+	CloseHandle(file_handle_);
+	file_handle_ = INVALID_HANDLE_VALUE;
+	map_handle_ = nullptr;
+#else
+	if (data_ != nullptr)
+	{
+		munmap((void*)data_, size_);
+	}
+	::close(fd_);
+	fd_ = -1;
+#endif
+
+	is_open_ = false;
+	data_ = nullptr;
+	size_ = 0;
+}
+
+void MappedFile::advise_sequential(size_t offset, size_t size) const
+{
+	Advise(offset, size, ADVICE_SEQUENTIAL);
+}
+
+void MappedFile::advise_willneed(size_t offset, size_t size) const
+{
+	Advise(offset, size, ADVICE_WILLNEED);
+}
+
+void MappedFile::advise_dontneed(size_t offset, size_t size) const
+{
+	Advise(offset, size, ADVICE_DONTNEED);
+}
+
+void MappedFile::Advise(size_t offset, size_t size, int advice) const
+{
+	if (data_ == nullptr || offset >= size_)
+	{
+		return;
+	}
+
+	if (size > size_ - offset)
+	{
+		size = size_ - offset;
+	}
+
+#ifndef _WIN32
+	// madvise requires a page aligned start address
+	static const size_t kPageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t page_offset = offset % kPageSize;
+	madvise((void*)(data_ + offset - page_offset), size + page_offset, advice);
+#endif
+}
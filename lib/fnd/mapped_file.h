@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <fnd/types.h>
+
+/*
+ Read-only memory mapped file.
+ Exposes the same data()/size() surface as MemoryBlob, but pages are only
+ brought into memory when they are first accessed.
+*/
+class MappedFile
+{
+public:
+	MappedFile();
+	MappedFile(const std::string& path);
+	~MappedFile();
+
+	void open(const std::string& path);
+	void close();
+
+	// access hints, offset/size are clamped to the mapped region
+	void advise_sequential(size_t offset, size_t size) const;
+	void advise_willneed(size_t offset, size_t size) const;
+	void advise_dontneed(size_t offset, size_t size) const;
+
+	inline bool is_open() const { return is_open_; }
+	inline const byte_t* data() const { return data_; }
+	inline size_t size() const { return size_; }
+private:
+	const std::string kModuleName = "MAPPED_FILE";
+
+	// non-copyable, the mapping is owned by this object
+	MappedFile(const MappedFile& other) = delete;
+	void operator=(const MappedFile& other) = delete;
+
+	bool is_open_;
+	const byte_t* data_;
+	size_t size_;
+#ifdef _WIN32
+	void* file_handle_;
+	void* map_handle_;
+#else
+	int fd_;
+#endif
+
+	void Advise(size_t offset, size_t size, int advice) const;
+};
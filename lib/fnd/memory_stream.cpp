@@ -0,0 +1,27 @@
+#include <cstring>
+#include "memory_stream.h"
+
+MemoryStream::MemoryStream(const u8 * data, size_t size) :
+	data_(data),
+	size_(size)
+{
+}
+
+MemoryStream::~MemoryStream()
+{
+}
+
+u64 MemoryStream::size()
+{
+	return size_;
+}
+
+void MemoryStream::read(u64 offset, size_t size, u8 * out)
+{
+	if (offset > size_ || size > size_ - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to read beyond end of stream");
+	}
+
+	memcpy(out, data_ + offset, size);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <fnd/io_stream.h>
+
+/*
+ IoStream over a caller owned buffer (MemoryBlob, MappedFile, static data).
+ The buffer must outlive the stream. Reads are thread safe.
+*/
+class MemoryStream : public IoStream
+{
+public:
+	MemoryStream(const u8* data, size_t size);
+	~MemoryStream();
+
+	u64 size();
+	void read(u64 offset, size_t size, u8* out);
+
+	inline const u8* data() const { return data_; }
+private:
+	const std::string kModuleName = "MEMORY_STREAM";
+
+	const u8* data_;
+	size_t size_;
+};
@@ -0,0 +1,389 @@
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <atomic>
+#include "output_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <process.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+OutputFile::OutputFile() :
+	path_(),
+	tmp_path_(),
+	sync_policy_(SYNC_NONE),
+	is_open_(false),
+	fd_(-1),
+	final_size_(0),
+	file_pos_(0),
+	buffer_storage_(),
+	buffer_(nullptr),
+	buffer_used_(0)
+{
+}
+
+OutputFile::OutputFile(const std::string & path, u64 final_size, SyncPolicy sync_policy) :
+	OutputFile()
+{
+	open(path, final_size, sync_policy);
+}
+
+OutputFile::~OutputFile()
+{
+	discard();
+}
+
+void OutputFile::open(const std::string & path, u64 final_size, SyncPolicy sync_policy)
+{
+	discard();
+
+	path_ = path;
+	sync_policy_ = sync_policy;
+	final_size_ = final_size;
+	file_pos_ = 0;
+	buffer_used_ = 0;
+
+	// the temporary name is unique to this writer and opened exclusively, so an existing file is never truncated or removed
+	static std::atomic<u32> tmp_counter(0);
+	fd_ = -1;
+	for (size_t attempt = 0; attempt < kTmpOpenAttemptNum && fd_ < 0; attempt++)
+	{
+#ifdef _WIN32
+		tmp_path_ = path + "." + std::to_string(_getpid()) + "." + std::to_string(tmp_counter++) + ".tmp";
+		fd_ = _open(tmp_path_.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY | _O_SEQUENTIAL, _S_IREAD | _S_IWRITE);
+#else
+		tmp_path_ = path + "." + std::to_string(getpid()) + "." + std::to_string(tmp_counter++) + ".tmp";
+		fd_ = ::open(tmp_path_.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+#endif
+		if (fd_ < 0 && errno != EEXIST)
+		{
+			break;
+		}
+	}
+	if (fd_ < 0)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to open " + tmp_path_ + " for writing");
+	}
+	is_open_ = true;
+
+	// allocate the final size up front so large outputs are laid out contiguously
+	Preallocate(final_size_);
+
+	// page aligned buffer, so flushes hand whole pages to the kernel
+	if (buffer_ == nullptr)
+	{
+		buffer_storage_.resize(kBufferLen + kBufferAlign);
+		buffer_ = buffer_storage_.data() + ((kBufferAlign - ((uintptr_t)buffer_storage_.data() % kBufferAlign)) % kBufferAlign);
+	}
+}
+
+void OutputFile::write(const u8 * data, size_t size)
+{
+	sIoVec vec = { data, size };
+	write(&vec, 1);
+}
+
+void OutputFile::write(const sIoVec * vec, size_t vec_num)
+{
+	if (is_open_ == false)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to write to a closed file");
+	}
+
+	for (size_t i = 0; i < vec_num; i++)
+	{
+		// large runs of data bypass the buffer, together with whatever is already buffered
+		if (vec[i].data != nullptr && vec[i].size >= kDirectWriteThreshold)
+		{
+			sIoVec direct[2] = { { buffer_, buffer_used_ }, vec[i] };
+			WriteDirect(direct, 2);
+			buffer_used_ = 0;
+			continue;
+		}
+
+		for (size_t pos = 0; pos < vec[i].size;)
+		{
+			if (buffer_used_ == kBufferLen)
+			{
+				Flush();
+			}
+
+			size_t copy_size = (vec[i].size - pos) < (kBufferLen - buffer_used_) ? (vec[i].size - pos) : (kBufferLen - buffer_used_);
+			if (vec[i].data != nullptr)
+			{
+				memcpy(buffer_ + buffer_used_, vec[i].data + pos, copy_size);
+			}
+			else
+			{
+				memset(buffer_ + buffer_used_, 0, copy_size);
+			}
+			buffer_used_ += copy_size;
+			pos += copy_size;
+		}
+	}
+}
+
+void OutputFile::pad(size_t size)
+{
+	sIoVec vec = { nullptr, size };
+	write(&vec, 1);
+}
+
+void OutputFile::skip(u64 size)
+{
+	if (is_open_ == false)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to write to a closed file");
+	}
+
+	// the skipped region reads back as zeros until it is written
+	Flush();
+	file_pos_ += size;
+}
+
+void OutputFile::write_at(u64 offset, const u8 * data, size_t size)
+{
+	if (is_open_ == false)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to write to a closed file");
+	}
+
+	// buffered data may overlap the region
+	{
+		std::lock_guard<std::mutex> lock(flush_mutex_);
+		Flush();
+	}
+
+	if (offset > file_pos_ || size > file_pos_ - offset)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to write beyond end of " + tmp_path_);
+	}
+
+	for (size_t pos = 0; pos < size;)
+	{
+#ifdef _WIN32
+		OVERLAPPED ov;
+		memset(&ov, 0, sizeof(OVERLAPPED));
+		ov.Offset = (DWORD)((offset + pos) & 0xffffffff);
+		ov.OffsetHigh = (DWORD)((offset + pos) >> 32);
+
+		DWORD write_size = (size - pos) < INT_MAX ? (DWORD)(size - pos) : INT_MAX;
+		DWORD written = 0;
+		int len = -1;
+		if (WriteFile((HANDLE)_get_osfhandle(fd_), data + pos, write_size, &written, &ov) != FALSE)
+		{
+			len = (int)written;
+		}
+#else
+		ssize_t len = pwrite(fd_, data + pos, size - pos, (off_t)(offset + pos));
+		if (len < 0 && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		if (len <= 0)
+		{
+			throw ProjectSnakeException(kModuleName, "Failed to write to " + tmp_path_);
+		}
+		pos += len;
+	}
+}
+
+void OutputFile::commit()
+{
+	if (is_open_ == false)
+	{
+		throw ProjectSnakeException(kModuleName, "Attempted to commit a closed file");
+	}
+
+	Flush();
+
+	// drop any preallocated space that was not used, or extend over a trailing skipped region
+#ifdef _WIN32
+	if (_chsize_s(fd_, (__int64)file_pos_) != 0)
+#else
+	if (ftruncate(fd_, (off_t)file_pos_) != 0)
+#endif
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to set size of " + tmp_path_);
+	}
+
+	if (sync_policy_ == SYNC_ON_COMMIT)
+	{
+#ifdef _WIN32
+		int ret = _commit(fd_);
+#else
+		int ret = fsync(fd_);
+#endif
+		if (ret != 0)
+		{
+			throw ProjectSnakeException(kModuleName, "Failed to sync " + tmp_path_);
+		}
+	}
+
+	CloseFile();
+
+	// replace the destination in one step
+#ifdef _WIN32
+	bool renamed = MoveFileExA(tmp_path_.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+#else
+	bool renamed = rename(tmp_path_.c_str(), path_.c_str()) == 0;
+#endif
+	if (renamed == false)
+	{
+		remove(tmp_path_.c_str());
+		throw ProjectSnakeException(kModuleName, "Failed to rename " + tmp_path_ + " to " + path_);
+	}
+
+#ifndef _WIN32
+	// the rename is only durable once the directory entry is on disk
+	if (sync_policy_ == SYNC_ON_COMMIT)
+	{
+		size_t pos = path_.find_last_of('/');
+		std::string dir = pos == std::string::npos ? "." : (pos == 0 ? "/" : path_.substr(0, pos));
+		int dir_fd = ::open(dir.c_str(), O_RDONLY);
+		if (dir_fd >= 0)
+		{
+			fsync(dir_fd);
+			::close(dir_fd);
+		}
+	}
+#endif
+}
+
+void OutputFile::discard()
+{
+	if (is_open_ == false)
+	{
+		return;
+	}
+
+	CloseFile();
+	remove(tmp_path_.c_str());
+}
+
+void OutputFile::Flush()
+{
+	if (buffer_used_ == 0)
+	{
+		return;
+	}
+
+	sIoVec vec = { buffer_, buffer_used_ };
+	WriteDirect(&vec, 1);
+	buffer_used_ = 0;
+}
+
+void OutputFile::WriteDirect(const sIoVec * vec, size_t vec_num)
+{
+#ifdef _WIN32
+	// write_at() and skip() move the file pointer
+	if (_lseeki64(fd_, (__int64)file_pos_, SEEK_SET) < 0)
+	{
+		throw ProjectSnakeException(kModuleName, "Failed to write to " + tmp_path_);
+	}
+
+	for (size_t i = 0; i < vec_num; i++)
+	{
+		for (size_t pos = 0; pos < vec[i].size;)
+		{
+			unsigned int write_size = (vec[i].size - pos) < INT_MAX ? (unsigned int)(vec[i].size - pos) : INT_MAX;
+			int len = _write(fd_, vec[i].data + pos, write_size);
+			if (len <= 0)
+			{
+				throw ProjectSnakeException(kModuleName, "Failed to write to " + tmp_path_);
+			}
+			pos += len;
+			file_pos_ += len;
+		}
+	}
+#else
+	static const size_t kMaxVecNum = 16;
+	struct iovec iov[kMaxVecNum];
+
+	size_t idx = 0;
+	size_t offset = 0; // bytes of vec[idx] already written
+	while (idx < vec_num)
+	{
+		// gather the remaining vectors
+		int iov_num = 0;
+		for (size_t i = idx; i < vec_num && iov_num < (int)kMaxVecNum; i++)
+		{
+			size_t skip = i == idx ? offset : 0;
+			if (vec[i].size - skip == 0)
+			{
+				continue;
+			}
+			iov[iov_num].iov_base = (void*)(vec[i].data + skip);
+			iov[iov_num].iov_len = vec[i].size - skip;
+			iov_num++;
+		}
+		if (iov_num == 0)
+		{
+			break;
+		}
+
+		// positional, so write_at() and skip() don't disturb the sequential stream
+		ssize_t len = pwritev(fd_, iov, iov_num, (off_t)file_pos_);
+		if (len < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (len <= 0)
+		{
+			throw ProjectSnakeException(kModuleName, "Failed to write to " + tmp_path_);
+		}
+		file_pos_ += len;
+
+		// advance past what was written
+		size_t written = (size_t)len;
+		while (idx < vec_num && written >= vec[idx].size - offset)
+		{
+			written -= vec[idx].size - offset;
+			offset = 0;
+			idx++;
+		}
+		offset += written;
+	}
+#endif
+}
+
+void OutputFile::Preallocate(u64 size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	// this is only a layout hint, filesystems that can't preallocate are written to normally
+#ifdef _WIN32
+	if (_chsize_s(fd_, (__int64)size) == 0)
+	{
+		_lseeki64(fd_, 0, SEEK_SET);
+	}
+#elif defined(__linux__)
+	posix_fallocate(fd_, 0, (off_t)size);
+#endif
+}
+
+void OutputFile::CloseFile()
+{
+#ifdef _WIN32
+	_close(fd_);
+#else
+	::close(fd_);
+#endif
+	fd_ = -1;
+	is_open_ = false;
+	buffer_used_ = 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fnd/types.h>
+
+/*
+ Buffered output file.
+ Data is written to "<path>.<pid>.<n>.tmp", which is preallocated to the
+ expected final size, and only renamed over <path> by commit(). An OutputFile destroyed
+ before commit() removes the temporary file, so a failed write never leaves a
+ half-written output behind.
+ write_at() may be called from several threads at once, but not while
+ write(), pad() or skip() are in progress.
+*/
+class OutputFile
+{
+public:
+	enum SyncPolicy
+	{
+		SYNC_NONE, // leave flushing to the OS
+		SYNC_ON_COMMIT, // fsync file (and directory) before commit() returns
+	};
+
+	// data == nullptr writes size zero bytes
+	struct sIoVec
+	{
+		const u8* data;
+		size_t size;
+	};
+
+	OutputFile();
+	OutputFile(const std::string& path, u64 final_size, SyncPolicy sync_policy);
+	~OutputFile();
+
+	void open(const std::string& path, u64 final_size, SyncPolicy sync_policy);
+	void write(const u8* data, size_t size);
+	void write(const sIoVec* vec, size_t vec_num);
+	void pad(size_t size);
+	void skip(u64 size); // leave a region to be filled in by write_at()
+	void write_at(u64 offset, const u8* data, size_t size); // write into a region that was already written or skipped
+	void commit();
+	void discard();
+
+	inline bool is_open() const { return is_open_; }
+	inline u64 tell() const { return file_pos_ + buffer_used_; }
+private:
+	const std::string kModuleName = "OUTPUT_FILE";
+	static const size_t kBufferLen = 0x400000;
+	static const size_t kBufferAlign = 0x1000;
+	static const size_t kDirectWriteThreshold = kBufferLen / 2; // larger vectors skip the buffer
+	static const size_t kTmpOpenAttemptNum = 16; // temporary names tried before giving up, in case stale ones are left over
+
+	// non-copyable, the file handle is owned by this object
+	OutputFile(const OutputFile& other) = delete;
+	void operator=(const OutputFile& other) = delete;
+
+	std::string path_;
+	std::string tmp_path_;
+	SyncPolicy sync_policy_;
+	bool is_open_;
+	int fd_;
+	u64 final_size_;
+	u64 file_pos_;
+
+	// aligned write buffer
+	std::vector<u8> buffer_storage_;
+	u8* buffer_;
+	size_t buffer_used_;
+	std::mutex flush_mutex_;
+
+	void Flush();
+	void WriteDirect(const sIoVec* vec, size_t vec_num);
+	void Preallocate(u64 size);
+	void CloseFile();
+};
@@ -0,0 +1,108 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool() :
+	active_num_(0),
+	is_stopping_(false)
+{
+	StartThreads(default_thread_num());
+}
+
+ThreadPool::ThreadPool(size_t thread_num) :
+	active_num_(0),
+	is_stopping_(false)
+{
+	StartThreads(thread_num > 0 ? thread_num : 1);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_stopping_ = true;
+		tasks_.clear();
+	}
+	task_ready_.notify_all();
+
+	for (auto& thread : threads_)
+	{
+		thread.join();
+	}
+}
+
+void ThreadPool::submit(const std::function<void()>& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		tasks_.push_back(task);
+	}
+	task_ready_.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	tasks_done_.wait(lock, [this] { return tasks_.empty() && active_num_ == 0; });
+
+	// the pool is reusable once the error has been reported
+	if (error_ != nullptr)
+	{
+		std::exception_ptr error = error_;
+		error_ = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+size_t ThreadPool::default_thread_num()
+{
+	// hardware_concurrency() may report 0 when the count is unknown
+	size_t thread_num = std::thread::hardware_concurrency();
+	return thread_num > 0 ? thread_num : 1;
+}
+
+void ThreadPool::StartThreads(size_t thread_num)
+{
+	for (size_t i = 0; i < thread_num; i++)
+	{
+		threads_.push_back(std::thread(&ThreadPool::WorkerMain, this));
+	}
+}
+
+void ThreadPool::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		task_ready_.wait(lock, [this] { return is_stopping_ || tasks_.empty() == false; });
+		if (is_stopping_)
+		{
+			return;
+		}
+
+		std::function<void()> task = tasks_.front();
+		tasks_.pop_front();
+		active_num_++;
+		lock.unlock();
+
+		std::exception_ptr error;
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		lock.lock();
+		active_num_--;
+		if (error != nullptr && error_ == nullptr)
+		{
+			error_ = error;
+			tasks_.clear();
+		}
+		if (tasks_.empty() && active_num_ == 0)
+		{
+			tasks_done_.notify_all();
+		}
+	}
+}
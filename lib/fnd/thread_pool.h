@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/*
+ Fixed size pool of worker threads.
+ Tasks run in submission order on whichever worker is free. wait() blocks
+ until every submitted task has finished and rethrows the first exception
+ a task threw; tasks still queued after a failure are skipped.
+*/
+class ThreadPool
+{
+public:
+	ThreadPool();
+	ThreadPool(size_t thread_num);
+	~ThreadPool();
+
+	void submit(const std::function<void()>& task);
+	void wait();
+
+	inline size_t thread_num() const { return threads_.size(); }
+	static size_t default_thread_num();
+private:
+	// non-copyable, workers hold a pointer to the pool
+	ThreadPool(const ThreadPool& other) = delete;
+	void operator=(const ThreadPool& other) = delete;
+
+	std::vector<std::thread> threads_;
+	std::deque<std::function<void()>> tasks_;
+	size_t active_num_;
+	bool is_stopping_;
+	std::exception_ptr error_;
+
+	std::mutex mutex_;
+	std::condition_variable task_ready_;
+	std::condition_variable tasks_done_;
+
+	void StartThreads(size_t thread_num);
+	void WorkerMain();
+};
@@ -0,0 +1,163 @@
+#include "thread_pool.h"
+#include "work_stealing_pool.h"
+
+// lets submit() tell whether it is called from one of the pool's own tasks
+static thread_local const WorkStealingPool* current_pool = nullptr;
+static thread_local size_t current_queue = 0;
+
+WorkStealingPool::WorkStealingPool() :
+	next_queue_(0),
+	queued_num_(0),
+	pending_num_(0),
+	is_stopping_(false)
+{
+	StartThreads(ThreadPool::default_thread_num());
+}
+
+WorkStealingPool::WorkStealingPool(size_t thread_num) :
+	next_queue_(0),
+	queued_num_(0),
+	pending_num_(0),
+	is_stopping_(false)
+{
+	StartThreads(thread_num > 0 ? thread_num : 1);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_stopping_ = true;
+	}
+	task_ready_.notify_all();
+
+	for (auto& thread : threads_)
+	{
+		thread.join();
+	}
+}
+
+void WorkStealingPool::submit(const std::function<void()>& task)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	size_t index = current_pool == this ? current_queue : (next_queue_++ % queues_.size());
+	{
+		std::lock_guard<std::mutex> queue_lock(queues_[index]->mutex);
+		queues_[index]->tasks.push_back(task);
+	}
+	queued_num_++;
+	pending_num_++;
+	task_ready_.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	tasks_done_.wait(lock, [this] { return pending_num_ == 0; });
+
+	// the pool is reusable once the error has been reported
+	if (error_ != nullptr)
+	{
+		std::exception_ptr error = error_;
+		error_ = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkStealingPool::StartThreads(size_t thread_num)
+{
+	for (size_t i = 0; i < thread_num; i++)
+	{
+		queues_.push_back(std::unique_ptr<sTaskQueue>(new sTaskQueue));
+	}
+	for (size_t i = 0; i < thread_num; i++)
+	{
+		threads_.push_back(std::thread(&WorkStealingPool::WorkerMain, this, i));
+	}
+}
+
+bool WorkStealingPool::TakeTask(size_t index, std::function<void()>& task)
+{
+	// newest task from our own queue first
+	{
+		sTaskQueue& queue = *queues_[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty() == false)
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			return true;
+		}
+	}
+
+	// otherwise the oldest task of another worker
+	for (size_t i = 1; i < queues_.size(); i++)
+	{
+		sTaskQueue& queue = *queues_[(index + i) % queues_.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty() == false)
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkStealingPool::WorkerMain(size_t index)
+{
+	current_pool = this;
+	current_queue = index;
+
+	while (true)
+	{
+		bool is_skipped;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			task_ready_.wait(lock, [this] { return is_stopping_ || queued_num_ > 0; });
+			if (is_stopping_)
+			{
+				return;
+			}
+
+			// claim one of the queued tasks, it can only be taken by whoever finds it first
+			queued_num_--;
+			is_skipped = error_ != nullptr;
+		}
+
+		// there are always at least as many queued tasks as claims, so this only spins while racing another taker
+		std::function<void()> task;
+		while (TakeTask(index, task) == false)
+		{
+			std::this_thread::yield();
+		}
+
+		std::exception_ptr error;
+		if (is_skipped == false)
+		{
+			try
+			{
+				task();
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+		}
+		task = nullptr;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_num_--;
+		if (error != nullptr && error_ == nullptr)
+		{
+			error_ = error;
+		}
+		if (pending_num_ == 0)
+		{
+			tasks_done_.notify_all();
+		}
+	}
+}
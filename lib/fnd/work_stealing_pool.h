@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/*
+ Fixed size pool of worker threads, each with its own task queue.
+ Tasks submitted from inside a task go on the submitting worker's queue and
+ are run newest first, so a task that splits its work keeps it local. Idle
+ workers steal the oldest task from another worker's queue. Tasks submitted
+ from outside the pool are spread over the queues.
+ wait() blocks until every submitted task, including those submitted by
+ tasks, has finished and rethrows the first exception a task threw; tasks
+ still queued after a failure are skipped. wait() must not be called from
+ a task.
+*/
+class WorkStealingPool
+{
+public:
+	WorkStealingPool();
+	WorkStealingPool(size_t thread_num);
+	~WorkStealingPool();
+
+	void submit(const std::function<void()>& task);
+	void wait();
+
+	inline size_t thread_num() const { return threads_.size(); }
+private:
+	// non-copyable, workers hold a pointer to the pool
+	WorkStealingPool(const WorkStealingPool& other) = delete;
+	void operator=(const WorkStealingPool& other) = delete;
+
+	struct sTaskQueue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<sTaskQueue>> queues_;
+	std::vector<std::thread> threads_;
+
+	// guarded by mutex_, queued tasks are counted so a woken worker knows one is waiting somewhere
+	size_t next_queue_;
+	size_t queued_num_;
+	size_t pending_num_;
+	bool is_stopping_;
+	std::exception_ptr error_;
+
+	std::mutex mutex_;
+	std::condition_variable task_ready_;
+	std::condition_variable tasks_done_;
+
+	void StartThreads(size_t thread_num);
+	bool TakeTask(size_t index, std::function<void()>& task);
+	void WorkerMain(size_t index);
+};
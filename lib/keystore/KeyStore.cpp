@@ -111,7 +111,7 @@ int KeyStore::SaveRsa2048Key(const YamlElement* node, Crypto::sRsa2048Key& rsa_k
 		memset(rsa_key.priv_exponent, 0, Crypto::kRsa2048Size);
 	}
 
-	return ERR_NOERROR;
+	return SaveRsaCrtParams(node, Crypto::kRsa2048Size / 2, rsa_key.prime_p, rsa_key.prime_q, rsa_key.exponent_dp, rsa_key.exponent_dq, rsa_key.coefficient_qp);
 }
 
 int KeyStore::SaveRsa4096Key(const YamlElement * node, Crypto::sRsa4096Key & rsa_key)
@@ -150,6 +150,60 @@ int KeyStore::SaveRsa4096Key(const YamlElement * node, Crypto::sRsa4096Key & rsa
 		memset(rsa_key.priv_exponent, 0, Crypto::kRsa4096Size);
 	}
 
+	return SaveRsaCrtParams(node, Crypto::kRsa4096Size / 2, rsa_key.prime_p, rsa_key.prime_q, rsa_key.exponent_dp, rsa_key.exponent_dq, rsa_key.coefficient_qp);
+}
+
+int KeyStore::SaveOptionalRsaParam(const YamlElement* node, const std::string& name, size_t len, u8* out)
+{
+	const YamlElement* param = node->GetChild(name);
+
+	if (param == nullptr || param->data().empty())
+	{
+		memset(out, 0, len);
+		return ERR_KSF_ELEMENT_NOT_PRESENT;
+	}
+
+	if (DecodeHexString(param->data()[0], len, out) != ERR_NOERROR)
+	{
+		memset(out, 0, len);
+		return ERR_DATA_CORRUPT;
+	}
+
+	return ERR_NOERROR;
+}
+
+int KeyStore::SaveRsaCrtParams(const YamlElement* node, size_t len, u8* prime_p, u8* prime_q, u8* exponent_dp, u8* exponent_dq, u8* coefficient_qp)
+{
+	// the CRT parameters only speed up signing, a key missing any of them keeps just D
+	int results[5] = {
+		SaveOptionalRsaParam(node, kPrimePStr, len, prime_p),
+		SaveOptionalRsaParam(node, kPrimeQStr, len, prime_q),
+		SaveOptionalRsaParam(node, kExponentDpStr, len, exponent_dp),
+		SaveOptionalRsaParam(node, kExponentDqStr, len, exponent_dq),
+		SaveOptionalRsaParam(node, kCoefficientQpStr, len, coefficient_qp),
+	};
+
+	bool is_complete = true, is_corrupt = false;
+	for (size_t i = 0; i < 5; i++)
+	{
+		is_complete &= results[i] == ERR_NOERROR;
+		is_corrupt |= results[i] == ERR_DATA_CORRUPT;
+	}
+
+	if (is_corrupt)
+	{
+		PrintElementLoadFailure(node->name(), "Invalid CRT parameter, using the private exponent only");
+	}
+
+	if (!is_complete)
+	{
+		memset(prime_p, 0, len);
+		memset(prime_q, 0, len);
+		memset(exponent_dp, 0, len);
+		memset(exponent_dq, 0, len);
+		memset(coefficient_qp, 0, len);
+	}
+
 	return ERR_NOERROR;
 }
 
@@ -427,8 +481,7 @@ int KeyStore::AddRsa2048Key(u8 id, const Crypto::sRsa2048Key & key, std::vector<
 	sRsa2048Key new_key;
 
 	new_key.id = id;
-	memcpy(new_key.key.modulus, key.modulus, Crypto::kRsa2048Size);
-	memcpy(new_key.key.priv_exponent, key.priv_exponent, Crypto::kRsa2048Size);
+	new_key.key = key;
 
 	key_list.push_back(new_key);
 
@@ -441,8 +494,7 @@ int KeyStore::GetRsa2048Key(const std::vector<sRsa2048Key>& key_list, u8 id, Cry
 	{
 		if (key.id == id)
 		{
-			memcpy(key_output.modulus, key.key.modulus, Crypto::kRsa2048Size);
-			memcpy(key_output.priv_exponent, key.key.priv_exponent, Crypto::kRsa2048Size);
+			key_output = key.key;
 			return ERR_NOERROR;
 		}
 	}
@@ -461,8 +513,7 @@ int KeyStore::AddRsa4096Key(u8 id, const Crypto::sRsa4096Key & key, std::vector<
 	sRsa4096Key new_key;
 
 	new_key.id = id;
-	memcpy(new_key.key.modulus, key.modulus, Crypto::kRsa4096Size);
-	memcpy(new_key.key.priv_exponent, key.priv_exponent, Crypto::kRsa4096Size);
+	new_key.key = key;
 
 	key_list.push_back(new_key);
 
@@ -475,8 +526,7 @@ int KeyStore::GetRsa4096Key(const std::vector<sRsa4096Key>& key_list, u8 id, Cry
 	{
 		if (key.id == id)
 		{
-			memcpy(key_output.modulus, key.key.modulus, Crypto::kRsa4096Size);
-			memcpy(key_output.priv_exponent, key.key.priv_exponent, Crypto::kRsa4096Size);
+			key_output = key.key;
 			return ERR_NOERROR;
 		}
 	}
@@ -545,32 +595,18 @@ void KeyStore::SetUpYamlLayout(void)
 	yaml_.AddChildToParent(kEsNodeStr, kCommonKeyStr, YamlElement::ELEMENT_NODE);
 	yaml_.AddChildToParent(kEsNodeStr + "/" + kCommonKeyStr, kIdStr, YamlElement::ELEMENT_SINGLE_KEY);
 	yaml_.AddChildToParent(kEsNodeStr + "/" + kCommonKeyStr, kAesKeyStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kEsNodeStr, kRootKeyStr, YamlElement::ELEMENT_NODE);
-	yaml_.AddChildToParent(kEsNodeStr + "/" + kRootKeyStr, kModulusStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kEsNodeStr + "/" + kRootKeyStr, kPrivateExponentStr, YamlElement::ELEMENT_SINGLE_KEY);
+	AddRsaKeyToYamlLayout(kEsNodeStr, kRootKeyStr);
 	yaml_.AddChildToParent(kEsNodeStr, kCaCertStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kEsNodeStr, kCaKeyStr, YamlElement::ELEMENT_NODE);
-	yaml_.AddChildToParent(kEsNodeStr + "/" + kCaKeyStr, kModulusStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kEsNodeStr + "/" + kCaKeyStr, kPrivateExponentStr, YamlElement::ELEMENT_SINGLE_KEY);
+	AddRsaKeyToYamlLayout(kEsNodeStr, kCaKeyStr);
 	yaml_.AddChildToParent(kEsNodeStr, kXsCertStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kEsNodeStr, kXsKeyStr, YamlElement::ELEMENT_NODE);
-	yaml_.AddChildToParent(kEsNodeStr + "/" + kXsKeyStr, kModulusStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kEsNodeStr + "/" + kXsKeyStr, kPrivateExponentStr, YamlElement::ELEMENT_SINGLE_KEY);
+	AddRsaKeyToYamlLayout(kEsNodeStr, kXsKeyStr);
 	yaml_.AddChildToParent(kEsNodeStr, kCpCertStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kEsNodeStr, kCpKeyStr, YamlElement::ELEMENT_NODE);
-	yaml_.AddChildToParent(kEsNodeStr + "/" + kCpKeyStr, kModulusStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kEsNodeStr + "/" + kCpKeyStr, kPrivateExponentStr, YamlElement::ELEMENT_SINGLE_KEY);
+	AddRsaKeyToYamlLayout(kEsNodeStr, kCpKeyStr);
 
 	yaml_.AddChildToRoot(kCtrNodeStr, YamlElement::ELEMENT_NODE);
-	yaml_.AddChildToParent(kCtrNodeStr, kNcsdCfaStr, YamlElement::ELEMENT_NODE);
-	yaml_.AddChildToParent(kCtrNodeStr + "/" + kNcsdCfaStr, kModulusStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kCtrNodeStr + "/" + kNcsdCfaStr, kPrivateExponentStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kCtrNodeStr, kAccessDescStr, YamlElement::ELEMENT_NODE);
-	yaml_.AddChildToParent(kCtrNodeStr + "/" + kAccessDescStr, kModulusStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kCtrNodeStr + "/" + kAccessDescStr, kPrivateExponentStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kCtrNodeStr, kCrrStr, YamlElement::ELEMENT_NODE);
-	yaml_.AddChildToParent(kCtrNodeStr + "/" + kCrrStr, kModulusStr, YamlElement::ELEMENT_SINGLE_KEY);
-	yaml_.AddChildToParent(kCtrNodeStr + "/" + kCrrStr, kPrivateExponentStr, YamlElement::ELEMENT_SINGLE_KEY);
+	AddRsaKeyToYamlLayout(kCtrNodeStr, kNcsdCfaStr);
+	AddRsaKeyToYamlLayout(kCtrNodeStr, kAccessDescStr);
+	AddRsaKeyToYamlLayout(kCtrNodeStr, kCrrStr);
 
 	yaml_.AddChildToParent(kCtrNodeStr, kAppFixedKeyStr, YamlElement::ELEMENT_SINGLE_KEY);
 	yaml_.AddChildToParent(kCtrNodeStr, kSysFixedKeyStr, YamlElement::ELEMENT_SINGLE_KEY);
@@ -578,3 +614,17 @@ void KeyStore::SetUpYamlLayout(void)
 	yaml_.AddChildToParent(kCtrNodeStr + "/" + kUnfixedKeyStr, kIdStr, YamlElement::ELEMENT_SINGLE_KEY);
 	yaml_.AddChildToParent(kCtrNodeStr + "/" + kUnfixedKeyStr, kAesKeyXStr, YamlElement::ELEMENT_SINGLE_KEY);
 }
+
+void KeyStore::AddRsaKeyToYamlLayout(const std::string& parent, const std::string& name)
+{
+	std::string path = parent + "/" + name;
+
+	yaml_.AddChildToParent(parent, name, YamlElement::ELEMENT_NODE);
+	yaml_.AddChildToParent(path, kModulusStr, YamlElement::ELEMENT_SINGLE_KEY);
+	yaml_.AddChildToParent(path, kPrivateExponentStr, YamlElement::ELEMENT_SINGLE_KEY);
+	yaml_.AddChildToParent(path, kPrimePStr, YamlElement::ELEMENT_SINGLE_KEY);
+	yaml_.AddChildToParent(path, kPrimeQStr, YamlElement::ELEMENT_SINGLE_KEY);
+	yaml_.AddChildToParent(path, kExponentDpStr, YamlElement::ELEMENT_SINGLE_KEY);
+	yaml_.AddChildToParent(path, kExponentDqStr, YamlElement::ELEMENT_SINGLE_KEY);
+	yaml_.AddChildToParent(path, kCoefficientQpStr, YamlElement::ELEMENT_SINGLE_KEY);
+}
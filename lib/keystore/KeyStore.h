@@ -75,6 +75,11 @@ private:
 	// generic rsa key strings
 	const std::string kModulusStr = "N";
 	const std::string kPrivateExponentStr = "D";
+	const std::string kPrimePStr = "P";
+	const std::string kPrimeQStr = "Q";
+	const std::string kExponentDpStr = "DP";
+	const std::string kExponentDqStr = "DQ";
+	const std::string kCoefficientQpStr = "QP";
 
 	// es keys
 	const std::string kEsNodeStr = "EsPki";
@@ -152,6 +157,8 @@ private:
 	int SaveRsa2048Key(const YamlElement* node, Crypto::sRsa2048Key& rsa_key);
 	int SaveRsa4096Key(const YamlElement* node, Crypto::sRsa4096Key& rsa_key);
 	int SaveEsCertificate(const YamlElement* node, ESCert& certificate);
+	int SaveOptionalRsaParam(const YamlElement* node, const std::string& name, size_t len, u8* out);
+	int SaveRsaCrtParams(const YamlElement* node, size_t len, u8* prime_p, u8* prime_q, u8* exponent_dp, u8* exponent_dq, u8* coefficient_qp);
 
 
 	int AddAesKey(u8 id, const u8* key, std::vector<sAesKey>& key_list);
@@ -167,4 +174,5 @@ private:
 
 	void PrintElementLoadFailure(const std::string& element_name, const std::string& failure_reason);
 	void SetUpYamlLayout(void);
+	void AddRsaKeyToYamlLayout(const std::string& parent, const std::string& name);
 };
@@ -1,7 +1,8 @@
 #include <fnd/types.h>
 #include <fnd/memory_blob.h>
-#include <fnd/file_io.h>
+#include <fnd/mapped_file.h>
 #include <fnd/project_snake_exception.h>
+#include <fnd/thread_pool.h>
 #include <crypto/crypto.h>
 #include <ctr/ctr_program_id.h>
 
@@ -11,6 +12,13 @@
 #include <ctr/cia_builder.h>
 
 #include <iostream>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+
+static const size_t kCciHeaderSize = 0x200;
+static const size_t kNcchHeaderSize = 0x200;
+static const u64 kDefaultMaxInflightSize = 0x40000000; // content bytes being converted at once in batch mode
 
 // keys
 static const Crypto::sRsa2048Key es_tik_key =
@@ -89,124 +97,322 @@ void AddFilePrefix(std::string& path, const std::string& prefix)
 	}
 }
 
-int main(int argc, char** argv)
+// parsed once and shared by every conversion
+struct sCiaSetup
+{
+	ESCert ca_cert;
+	ESCert tik_cert;
+	ESCert tmd_cert;
+	CiaFooter sysupd_footer;
+	size_t thread_num; // threads each cia is built with, 0 for one per core
+};
+
+// caps the content bytes being converted at once, a conversion larger than the whole budget waits until it can run alone
+class ContentBudget
 {
-	if (argc != 2) 
+public:
+	ContentBudget(u64 max_size) :
+		max_size_(max_size),
+		used_size_(0)
 	{
-		printf("usage: %s <input CSU file>\n", argv[0]);
-		return 0;
 	}
 
-	MemoryBlob ncsd;
+	void Acquire(u64 size)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		released_.wait(lock, [this, size] { return used_size_ == 0 || used_size_ + size <= max_size_; });
+		used_size_ += size;
+	}
+
+	void Release(u64 size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		used_size_ -= size;
+		released_.notify_all();
+	}
+
+private:
+	u64 max_size_;
+	u64 used_size_;
+	std::mutex mutex_;
+	std::condition_variable released_;
+};
+
+// one path per line, blank lines and lines starting with '#' are skipped
+void ReadManifest(const std::string& path, std::vector<std::string>& inputs)
+{
+	std::ifstream manifest(path);
+	if (manifest.is_open() == false)
+	{
+		throw ProjectSnakeException("Failed to open manifest \"" + path + "\"");
+	}
+
+	std::string line;
+	while (std::getline(manifest, line))
+	{
+		if (line.empty() == false && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		inputs.push_back(line);
+	}
+}
+
+void PrintError(const ProjectSnakeException& except)
+{
+	if (except.module()[0] != '\0')
+	{
+		printf("[MAKECSUCIA ERROR][%s] %s\n", except.module(), except.what());
+	}
+	else
+	{
+		printf("[MAKECSUCIA ERROR] %s\n", except.what());
+	}
+}
+
+void ConvertCsu(const std::string& in_path, const sCiaSetup& setup, ContentBudget& budget)
+{
+	MappedFile ncsd;
 	NcchHeader ncch;
 	CciHeader hdr;
 	
 	// Open NCSD + Header
-	try {
-		FileIO::ReadFile(argv[1], ncsd);
-
-		hdr.DeserialiseHeader(ncsd.data());
-	
-		// validate signature
-		if (hdr.ValidateSignature(ncsd_key) != true)
-		{
-			throw ProjectSnakeException("CCI has invalid RSA signature.");
-		}
+	ncsd.open(in_path);
+	if (ncsd.size() < kCciHeaderSize)
+	{
+		throw ProjectSnakeException("File is too small to be a CCI.");
+	}
 
-		ncch.DeserialiseHeader(ncsd.data() + hdr.GetPartition(0).offset);
+	hdr.DeserialiseHeader(ncsd.data());
 
-#ifdef SYSUPD_RESTRICT
-		if (hdr.GetMediaType() != CciHeader::MEDIA_TYPE_CARD1 || hdr.GetBackupSecurityType() != CciHeader::CARD_DEVICE_NONE)
-		{
-			throw ProjectSnakeException("CCI is not a CTR System Utility");
-		}
+	// validate signature
+	if (hdr.ValidateSignature(ncsd_key) != true)
+	{
+		throw ProjectSnakeException("CCI has invalid RSA signature.");
+	}
 
-		if (CtrProgramId::get_unique_id(hdr.GetTitleId()) != 0xff402) 
+	// the file is mapped, so partitions beyond the end of file must be rejected before they are touched
+	for (int i = 0; i < CciHeader::kSectionNum; i++)
+	{
+		if (hdr.GetPartition(i).size > 0 && (hdr.GetPartition(i).offset > ncsd.size() || hdr.GetPartition(i).size > ncsd.size() - hdr.GetPartition(i).offset))
 		{
-			throw ProjectSnakeException("CSU is not a SystemUpdater.");
+			throw ProjectSnakeException("CCI is truncated.");
 		}
-#endif
 	}
-	catch (const ProjectSnakeException& except) {
-		printf("[MAKECSUCIA ERROR] %s\n", except.what());
-		return 1; 
+
+	// partition 0's header is read below, so it must be present even though empty partitions are otherwise allowed
+	if (hdr.GetPartition(0).size < kNcchHeaderSize)
+	{
+		throw ProjectSnakeException("CCI has no NCCH in partition 0.");
 	}
 
+	ncch.DeserialiseHeader(ncsd.data() + hdr.GetPartition(0).offset);
 
+#ifdef SYSUPD_RESTRICT
+	if (hdr.GetMediaType() != CciHeader::MEDIA_TYPE_CARD1 || hdr.GetBackupSecurityType() != CciHeader::CARD_DEVICE_NONE)
+	{
+		throw ProjectSnakeException("CCI is not a CTR System Utility");
+	}
+
+	if (CtrProgramId::get_unique_id(hdr.GetTitleId()) != 0xff402) 
+	{
+		throw ProjectSnakeException("CSU is not a SystemUpdater.");
+	}
+#endif
 
 	// Configure CIA
 	CiaBuilder cia;
 	u8 title_key[Crypto::kAes128KeySize] = { 0 };
-	try {
-		cia.SetCaCert(es_ca_cert);
-		cia.SetTicketSigner(es_tik_key, es_tik_cert);
-		cia.SetTmdSigner(es_tmd_key, es_tmd_cert);
+	cia.SetCaCert(setup.ca_cert);
+	cia.SetTicketSigner(es_tik_key, setup.tik_cert);
+	cia.SetTmdSigner(es_tmd_key, setup.tmd_cert);
 
-		cia.SetTitleId(hdr.GetTitleId());
-		cia.SetVersion(0);
+	cia.SetTitleId(hdr.GetTitleId());
+	cia.SetVersion(0);
 
-		// provide appriate save data size, based on card configuration
-		if (hdr.GetCardDevice() == CciHeader::CARD_DEVICE_NOR_FLASH) {
-			cia.SetCxiSaveDataSize(512 * 1024); // 512KB
-		}
-		else if (hdr.GetCardDevice() == CciHeader::CARD_DEVICE_NONE && hdr.GetMediaType() == CciHeader::MEDIA_TYPE_CARD2) {
-			cia.SetCxiSaveDataSize(2 * 1024 * 1024); // 2MB
-		}
-		else {
-			cia.SetCxiSaveDataSize(0); // no save data
-		}
+	// provide appriate save data size, based on card configuration
+	if (hdr.GetCardDevice() == CciHeader::CARD_DEVICE_NOR_FLASH) {
+		cia.SetCxiSaveDataSize(512 * 1024); // 512KB
+	}
+	else if (hdr.GetCardDevice() == CciHeader::CARD_DEVICE_NONE && hdr.GetMediaType() == CciHeader::MEDIA_TYPE_CARD2) {
+		cia.SetCxiSaveDataSize(2 * 1024 * 1024); // 2MB
+	}
+	else {
+		cia.SetCxiSaveDataSize(0); // no save data
+	}
 
-		int commonKeyId = 0;
-		if (ncch.IsEncrypted() == true && ncch.IsFixedAesKey() == false)
-		{
-			// randomise title key
-			//memset(title_key, 0xBE, Crypto::kAes128KeySize);
-			commonKeyId = 1;
-		}
-		else
-		{
-			memset(title_key, 0, Crypto::kAes128KeySize);
-			commonKeyId = 0;
-		}
-		cia.SetCommonKey(es_commonkey_dev[commonKeyId], commonKeyId);
-		cia.SetTitleKey(title_key);
-		cia.SetTicketId(0); // randomise ticketID
+	int commonKeyId = 0;
+	if (ncch.IsEncrypted() == true && ncch.IsFixedAesKey() == false)
+	{
+		// randomise title key
+		//memset(title_key, 0xBE, Crypto::kAes128KeySize);
+		commonKeyId = 1;
+	}
+	else
+	{
+		memset(title_key, 0, Crypto::kAes128KeySize);
+		commonKeyId = 0;
+	}
+	cia.SetCommonKey(es_commonkey_dev[commonKeyId], commonKeyId);
+	cia.SetTitleKey(title_key);
+	cia.SetTicketId(0); // randomise ticketID
 
-		// Add only executable/emanual/dlpchild from csu to cia
-		for (int i = 0; i < CciHeader::kSectionNum; i++)
-		{
-			if (hdr.GetPartition(i).size == 0) continue;
+	// Add only executable/emanual/dlpchild from csu to cia
+	u64 content_size = 0;
+	for (int i = 0; i < CciHeader::kSectionNum; i++)
+	{
+		if (hdr.GetPartition(i).size == 0) continue;
 
-			if (i != CciHeader::SECTION_EXEC && i != CciHeader::SECTION_EMANUAL && i != CciHeader::SECTION_DLP_CHILD) continue;
+		if (i != CciHeader::SECTION_EXEC && i != CciHeader::SECTION_EMANUAL && i != CciHeader::SECTION_DLP_CHILD) continue;
 
-			// randomise content id
-			cia.AddContent(i, i, ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED, ncsd.data() + hdr.GetPartition(i).offset, hdr.GetPartition(i).size);
-		}
+		// partitions are read once, front to back
+		ncsd.advise_sequential(hdr.GetPartition(i).offset, hdr.GetPartition(i).size);
 
-		// if this is a system updater, append the footer
-		if (CtrProgramId::get_unique_id(hdr.GetTitleId()) == 0xff402)
-		{
-			CiaFooter footer;
-			footer.DeserialiseFooter(sysupd_footer, sizeof(sysupd_footer));
-			cia.SetFooter(footer.GetDependencyList(), footer.GetFirmwareTitleId(), footer.GetIcon(), footer.GetIconSize());
-		}
-		
+		// randomise content id
+		cia.AddContent(i, i, ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED, ncsd.data() + hdr.GetPartition(i).offset, hdr.GetPartition(i).size);
+		content_size += hdr.GetPartition(i).size;
+	}
 
-		// Create CIA
-		cia.CreateCia();
+	// if this is a system updater, append the footer
+	if (CtrProgramId::get_unique_id(hdr.GetTitleId()) == 0xff402)
+	{
+		cia.SetFooter(setup.sysupd_footer.GetDependencyList(), setup.sysupd_footer.GetFirmwareTitleId(), setup.sysupd_footer.GetIcon(), setup.sysupd_footer.GetIconSize());
+	}
+	
 
-		// Create outpath
-		std::string path(argv[1]);
-		ReplaceFileExtention(path, ".cia");
-		AddFilePrefix(path, "SD_");
+	// Create CIA
+	cia.SetThreadNum(setup.thread_num);
+	cia.CreateCia();
 
+	// Create outpath
+	std::string path(in_path);
+	ReplaceFileExtention(path, ".cia");
+	AddFilePrefix(path, "SD_");
+
+	// content is only read from here on
+	budget.Acquire(content_size);
+	try {
 		cia.WriteToFile(path.c_str());
 	}
+	catch (...) {
+		budget.Release(content_size);
+		throw;
+	}
+	budget.Release(content_size);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) 
+	{
+		printf("usage: %s [-j <jobs>] [-M <MiB in flight>] [-m <manifest>] <input CSU file> ...\n", argv[0]);
+		return 0;
+	}
+
+	std::vector<std::string> inputs;
+	size_t job_num = 0;
+	u64 max_inflight_size = kDefaultMaxInflightSize;
+	sCiaSetup setup;
+	setup.thread_num = 0;
+	try {
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg(argv[i]);
+			if ((arg == "-j" || arg == "-M" || arg == "-m") && i + 1 >= argc)
+			{
+				throw ProjectSnakeException("Option " + arg + " needs a value.");
+			}
+
+			if (arg == "-j")
+			{
+				job_num = strtoul(argv[++i], nullptr, 0);
+			}
+			else if (arg == "-M")
+			{
+				max_inflight_size = (u64)strtoull(argv[++i], nullptr, 0) * 0x100000;
+			}
+			else if (arg == "-m")
+			{
+				ReadManifest(argv[++i], inputs);
+			}
+			else
+			{
+				inputs.push_back(arg);
+			}
+		}
+
+		// certificates and footer are the same for every cia, signing keys are prepared once by Crypto on first use
+		setup.ca_cert.DeserialiseCert(es_ca_cert);
+		setup.tik_cert.DeserialiseCert(es_tik_cert);
+		setup.tmd_cert.DeserialiseCert(es_tmd_cert);
+		setup.sysupd_footer.DeserialiseFooter(sysupd_footer, sizeof(sysupd_footer));
+	}
 	catch (const ProjectSnakeException& except) {
-		printf("[MAKECSUCIA ERROR][%s] %s\n", except.module(), except.what());
+		PrintError(except);
 		return 1;
 	}
-	
 
-	return 0;
-}
\ No newline at end of file
+	ContentBudget budget(max_inflight_size);
+
+	if (inputs.size() == 1)
+	{
+		try {
+			ConvertCsu(inputs[0], setup, budget);
+		}
+		catch (const ProjectSnakeException& except) {
+			PrintError(except);
+			return 1;
+		}
+		return 0;
+	}
+
+	// batch mode, each conversion is one job on a bounded pool and is built on that job's thread alone
+	if (job_num == 0)
+	{
+		job_num = ThreadPool::default_thread_num();
+	}
+	setup.thread_num = 1;
+	ThreadPool pool(inputs.size() < job_num ? inputs.size() : job_num);
+	std::mutex output_mutex;
+	size_t fail_num = 0;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		pool.submit([&inputs, &setup, &budget, &output_mutex, &fail_num, i]()
+		{
+			try {
+				ConvertCsu(inputs[i], setup, budget);
+			}
+			catch (const ProjectSnakeException& except) {
+				std::lock_guard<std::mutex> lock(output_mutex);
+				if (except.module()[0] != '\0')
+				{
+					printf("[MAKECSUCIA ERROR][%s][%s] %s\n", inputs[i].c_str(), except.module(), except.what());
+				}
+				else
+				{
+					printf("[MAKECSUCIA ERROR][%s] %s\n", inputs[i].c_str(), except.what());
+				}
+				fail_num++;
+			}
+			catch (const std::exception& except) {
+				std::lock_guard<std::mutex> lock(output_mutex);
+				printf("[MAKECSUCIA ERROR][%s] %s\n", inputs[i].c_str(), except.what());
+				fail_num++;
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(output_mutex);
+				printf("[MAKECSUCIA ERROR][%s] Unknown error\n", inputs[i].c_str());
+				fail_num++;
+			}
+		});
+	}
+	pool.wait();
+
+	printf("[MAKECSUCIA] Converted %zu of %zu files\n", inputs.size() - fail_num, inputs.size());
+
+	return fail_num == 0 ? 0 : 1;
+}
@@ -0,0 +1,325 @@
+#include "cia_verifier.h"
+
+bool CiaVerifier::sFileResult::is_valid() const
+{
+	if (error.empty() == false || is_certs_valid == false || is_ticket_valid == false || is_tmd_valid == false)
+	{
+		return false;
+	}
+
+	for (const auto& content : contents)
+	{
+		if (content.is_valid == false)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+CiaVerifier::CiaVerifier(WorkStealingPool& pool, const u8 (*common_keys)[Crypto::kAes128KeySize], size_t common_key_num) :
+	pool_(pool),
+	common_keys_(common_keys),
+	common_key_num_(common_key_num),
+	has_root_key_(false),
+	paths_(nullptr),
+	results_(nullptr),
+	next_file_(0)
+{
+}
+
+CiaVerifier::~CiaVerifier()
+{
+}
+
+void CiaVerifier::SetRootKey(const Crypto::sRsa4096Key& root_key)
+{
+	root_key_ = root_key;
+	has_root_key_ = true;
+}
+
+void CiaVerifier::SetResultCallback(const std::function<void(const sFileResult&)>& callback)
+{
+	callback_ = callback;
+}
+
+void CiaVerifier::VerifyFiles(const std::vector<std::string>& paths, std::vector<sFileResult>& results)
+{
+	paths_ = &paths;
+	results_ = &results;
+	next_file_ = 0;
+	results.clear();
+	results.resize(paths.size());
+	file_jobs_.clear();
+	file_jobs_.resize(paths.size());
+
+	// a few files per worker keeps every worker busy, without opening the whole list at once
+	size_t file_window = pool_.thread_num() * 2;
+	for (size_t i = 0; i < file_window && i < paths.size(); i++)
+	{
+		StartNextFile();
+	}
+	pool_.wait();
+
+	paths_ = nullptr;
+	results_ = nullptr;
+	file_jobs_.clear();
+}
+
+void CiaVerifier::StartNextFile()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (next_file_ >= paths_->size())
+	{
+		return;
+	}
+
+	sFileJob* job = new sFileJob;
+	file_jobs_[next_file_].reset(job);
+	job->index = next_file_;
+	job->result.path = (*paths_)[next_file_];
+	job->result.title_id = 0;
+	job->result.title_version = 0;
+	job->result.is_ca_checked = has_root_key_;
+	job->result.is_certs_valid = false;
+	job->result.is_ticket_valid = false;
+	job->result.is_tmd_valid = false;
+	job->result.content_size = 0;
+	job->pending_content_num = 0;
+	job->next_content = 0;
+	job->next_segment = 0;
+	next_file_++;
+
+	pool_.submit([this, job]() { VerifyFile(*job); });
+}
+
+void CiaVerifier::VerifyFile(sFileJob& job)
+{
+	sFileResult& result = job.result;
+	try
+	{
+		// only the metadata is read here, content is read by the segment tasks
+		job.stream.open(result.path);
+		job.reader.ImportCiaMetadata(job.stream);
+
+		result.title_id = job.reader.GetTitleId();
+		result.title_version = job.reader.GetTitleVersion();
+		result.is_certs_valid = has_root_key_ ? job.reader.ValidateCertificates(root_key_) : job.reader.ValidateCertificatesExceptCa();
+		result.is_ticket_valid = job.reader.ValidateTicket();
+		result.is_tmd_valid = job.reader.ValidateTmd();
+
+		if (job.reader.GetCommonKeyIndex() >= common_key_num_)
+		{
+			throw ProjectSnakeException(kModuleName, "Ticket uses an unknown common key");
+		}
+		job.key.reset(new AesKeySchedule(job.reader.GetTitleKey(common_keys_[job.reader.GetCommonKeyIndex()])));
+
+		const std::vector<ESContent>& content_list = job.reader.GetContentList();
+		result.contents.resize(content_list.size());
+		for (size_t i = 0; i < content_list.size(); i++)
+		{
+			sContentJob* content_job = new sContentJob;
+			job.contents.push_back(std::unique_ptr<sContentJob>(content_job));
+			content_job->file = &job;
+			content_job->index = i;
+			content_job->content = &content_list[i];
+			content_job->segment_num = content_list[i].GetSize() > 0 ? (content_list[i].GetSize() + kSegmentSize - 1) / kSegmentSize : 1;
+			content_job->next_hash = 0;
+			content_job->is_hashing = false;
+			content_job->is_failed = false;
+			content_job->hash_ctx.init(content_list[i].IsSha1Hash());
+
+			result.contents[i].content_id = content_list[i].GetContentId();
+			result.contents[i].content_index = content_list[i].GetContentIndex();
+			result.contents[i].size = content_list[i].GetSize();
+			result.contents[i].is_valid = false;
+			result.content_size += content_list[i].GetSize();
+		}
+	}
+	catch (const std::exception& except)
+	{
+		result.error = except.what();
+	}
+	catch (...)
+	{
+		result.error = "Unknown error";
+	}
+
+	if (result.error.empty() == false)
+	{
+		job.contents.clear();
+		result.contents.clear();
+	}
+
+	if (job.contents.empty())
+	{
+		FinishFile(job);
+		return;
+	}
+
+	// the file job is released by the last content to finish, which can't happen until the lock is released
+	job.pending_content_num = job.contents.size();
+	std::lock_guard<std::mutex> lock(job.mutex);
+	for (size_t i = 0; i < kSegmentWindow; i++)
+	{
+		SubmitNextSegment(job);
+	}
+}
+
+void CiaVerifier::FinishFile(sFileJob& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		(*results_)[job.index] = job.result;
+		if (callback_)
+		{
+			callback_(job.result);
+		}
+
+		// the stream and parsed sections aren't needed any more
+		file_jobs_[job.index].reset();
+	}
+
+	StartNextFile();
+}
+
+void CiaVerifier::SubmitNextSegment(sFileJob& job)
+{
+	// job.mutex must be held, a content's segments are all submitted before the next content's, so the earliest unhashed segment is always in flight
+	if (job.next_content >= job.contents.size())
+	{
+		return;
+	}
+
+	sContentJob* content = job.contents[job.next_content].get();
+	u64 segment = job.next_segment++;
+	if (job.next_segment >= content->segment_num)
+	{
+		job.next_content++;
+		job.next_segment = 0;
+	}
+
+	pool_.submit([this, content, segment]() { ReadSegment(*content, segment); });
+}
+
+void CiaVerifier::ReadSegment(sContentJob& job, u64 segment)
+{
+	const ESContent& content = *job.content;
+	u64 offset = segment * kSegmentSize;
+	size_t size = (content.GetSize() - offset) < kSegmentSize ? (size_t)(content.GetSize() - offset) : kSegmentSize;
+
+	// segments of a content that has already failed aren't read, they only take their turn
+	bool is_failed;
+	{
+		std::lock_guard<std::mutex> lock(job.mutex);
+		is_failed = job.is_failed;
+	}
+	if (is_failed)
+	{
+		std::vector<u8> empty;
+		HashSegments(job, segment, empty);
+		return;
+	}
+
+	// the data goes after one block of room, where encrypted segments get the iv
+	std::vector<u8> data;
+	try
+	{
+		data.resize(Crypto::kAesBlockSize + size);
+		if (content.IsFlagSet(ESContentInfo::ES_CONTENT_FLAG_ENCRYPTED))
+		{
+			content.ReadDecryptedData(offset, size, *job.file->key, data.data());
+		}
+		else
+		{
+			content.ReadData(offset, size, data.data() + Crypto::kAesBlockSize);
+		}
+	}
+	catch (...)
+	{
+		// the segment still takes its turn, so the content is finished and reported as invalid
+		std::lock_guard<std::mutex> lock(job.mutex);
+		job.is_failed = true;
+	}
+
+	HashSegments(job, segment, data);
+}
+
+void CiaVerifier::HashSegments(sContentJob& job, u64 segment, std::vector<u8>& data)
+{
+	std::unique_lock<std::mutex> lock(job.mutex);
+	job.segments[segment].swap(data);
+
+	// once a content has failed the segments not yet submitted are dropped, the content ends after those in flight
+	if (job.is_failed)
+	{
+		std::lock_guard<std::mutex> file_lock(job.file->mutex);
+		if (job.file->next_content == job.index)
+		{
+			job.segment_num = job.file->next_segment;
+			job.file->next_content++;
+			job.file->next_segment = 0;
+		}
+	}
+
+	// only one task hashes a content at a time, the others just leave their segment behind
+	if (job.is_hashing)
+	{
+		return;
+	}
+	job.is_hashing = true;
+
+	for (auto itr = job.segments.find(job.next_hash); itr != job.segments.end(); itr = job.segments.find(job.next_hash))
+	{
+		std::vector<u8> ready;
+		ready.swap(itr->second);
+		job.segments.erase(itr);
+
+		// a segment has left the window, so the next one of the file can start
+		{
+			std::lock_guard<std::mutex> file_lock(job.file->mutex);
+			SubmitNextSegment(*job.file);
+		}
+
+		bool is_failed = job.is_failed;
+		lock.unlock();
+		if (is_failed == false)
+		{
+			job.hash_ctx.update(ready.data() + Crypto::kAesBlockSize, ready.size() - Crypto::kAesBlockSize);
+		}
+		lock.lock();
+
+		job.next_hash++;
+	}
+
+	job.is_hashing = false;
+	bool is_done = job.next_hash == job.segment_num;
+	lock.unlock();
+
+	if (is_done)
+	{
+		FinishContent(job);
+	}
+}
+
+void CiaVerifier::FinishContent(sContentJob& job)
+{
+	sFileJob& file = *job.file;
+
+	u8 hash[Crypto::kSha256HashLen];
+	job.hash_ctx.final(hash);
+	file.result.contents[job.index].is_valid = job.is_failed == false && job.content->ValidateHash(hash);
+
+	bool is_file_done;
+	{
+		std::lock_guard<std::mutex> lock(file.mutex);
+		file.pending_content_num--;
+		is_file_done = file.pending_content_num == 0;
+	}
+
+	// this releases the file job, including this content job
+	if (is_file_done)
+	{
+		FinishFile(file);
+	}
+}
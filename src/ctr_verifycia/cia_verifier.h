@@ -0,0 +1,118 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <fnd/types.h>
+#include <fnd/file_stream.h>
+#include <fnd/work_stealing_pool.h>
+#include <crypto/crypto.h>
+#include <crypto/aes_key_schedule.h>
+#include <ctr/cia_reader.h>
+
+/*
+ Verifies a list of CIA files on a shared work stealing pool.
+ Each file is a task that checks the header, certificates, ticket and tmd,
+ then splits its contents into segments that are read and decrypted as
+ separate tasks. CBC decryption of a segment only needs the ciphertext
+ block before it, so segments of one content run on any worker; their
+ hashes are chained in order by whichever task completes the next one.
+ Segments in flight per file and files open at once are bounded, so memory
+ doesn't grow with the number of contents.
+*/
+class CiaVerifier
+{
+public:
+	struct sContentResult
+	{
+		u32 content_id;
+		u16 content_index;
+		u64 size;
+		bool is_valid;
+	};
+
+	struct sFileResult
+	{
+		std::string path;
+		std::string error; // set when the file could not be read or parsed
+		u64 title_id;
+		u16 title_version;
+		bool is_ca_checked;
+		bool is_certs_valid;
+		bool is_ticket_valid;
+		bool is_tmd_valid;
+		std::vector<sContentResult> contents;
+		u64 content_size;
+
+		bool is_valid() const;
+	};
+
+	CiaVerifier(WorkStealingPool& pool, const u8 (*common_keys)[Crypto::kAes128KeySize], size_t common_key_num);
+	~CiaVerifier();
+
+	void SetRootKey(const Crypto::sRsa4096Key& root_key); // without it the certificates signed by "Root" aren't checked
+	void SetResultCallback(const std::function<void(const sFileResult&)>& callback); // called once per file as it completes, never concurrently
+
+	void VerifyFiles(const std::vector<std::string>& paths, std::vector<sFileResult>& results);
+
+private:
+	const std::string kModuleName = "CIA_VERIFIER";
+	static const size_t kSegmentSize = 0x100000;
+	static const size_t kSegmentWindow = 8; // segments of one file read or awaiting hashing at once
+
+	struct sFileJob;
+
+	struct sContentJob
+	{
+		sFileJob* file;
+		size_t index;
+		const ESContent* content;
+		u64 segment_num; // cut to the segments already submitted once the content fails
+
+		std::mutex mutex;
+		u64 next_hash;
+		bool is_hashing;
+		bool is_failed;
+		std::map<u64, std::vector<u8>> segments; // decrypted, waiting for their turn to be hashed
+		ESContent::sHashContext hash_ctx;
+	};
+
+	struct sFileJob
+	{
+		size_t index;
+		sFileResult result;
+		FileStream stream;
+		CiaReader reader;
+		std::unique_ptr<AesKeySchedule> key;
+		std::vector<std::unique_ptr<sContentJob>> contents;
+
+		std::mutex mutex;
+		size_t pending_content_num;
+		size_t next_content; // next segment to submit, contents are submitted in order
+		u64 next_segment;
+	};
+
+	WorkStealingPool& pool_;
+	const u8 (*common_keys_)[Crypto::kAes128KeySize];
+	size_t common_key_num_;
+	bool has_root_key_;
+	Crypto::sRsa4096Key root_key_;
+	std::function<void(const sFileResult&)> callback_;
+
+	// state of the current VerifyFiles() call
+	std::mutex mutex_;
+	const std::vector<std::string>* paths_;
+	std::vector<sFileResult>* results_;
+	size_t next_file_;
+	std::vector<std::unique_ptr<sFileJob>> file_jobs_;
+
+	void StartNextFile();
+	void VerifyFile(sFileJob& job);
+	void FinishFile(sFileJob& job);
+	void SubmitNextSegment(sFileJob& job);
+	void ReadSegment(sContentJob& job, u64 segment);
+	void HashSegments(sContentJob& job, u64 segment, std::vector<u8>& data);
+	void FinishContent(sContentJob& job);
+};
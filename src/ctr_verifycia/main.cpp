@@ -0,0 +1,300 @@
+#include <cstdio>
+#include <cinttypes>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include <fnd/types.h>
+#include <fnd/memory_blob.h>
+#include <fnd/file_io.h>
+#include <fnd/project_snake_exception.h>
+#include <fnd/thread_pool.h>
+#include <fnd/work_stealing_pool.h>
+#include <crypto/crypto.h>
+
+#include "cia_verifier.h"
+
+// keys
+static const u8 es_commonkey_dev[6][0x10] =
+{
+	{ 0x55, 0xA3, 0xF8, 0x72, 0xBD, 0xC8, 0x0C, 0x55, 0x5A, 0x65, 0x43, 0x81, 0x13, 0x9E, 0x15, 0x3B } , // 0 - Applications
+	{ 0x44, 0x34, 0xED, 0x14, 0x82, 0x0C, 0xA1, 0xEB, 0xAB, 0x82, 0xC1, 0x6E, 0x7B, 0xEF, 0x0C, 0x25 } , // 1 - Secure Titles
+	{ 0xF6, 0x2E, 0x3F, 0x95, 0x8E, 0x28, 0xA2, 0x1F, 0x28, 0x9E, 0xEC, 0x71, 0xA8, 0x66, 0x29, 0xDC } , // 2
+	{ 0x2B, 0x49, 0xCB, 0x6F, 0x99, 0x98, 0xD9, 0xAD, 0x94, 0xF2, 0xED, 0xE7, 0xB5, 0xDA, 0x3E, 0x27 } , // 3
+	{ 0x75, 0x05, 0x52, 0xBF, 0xAA, 0x1C, 0x04, 0x07, 0x55, 0xC8, 0xD5, 0x9A, 0x55, 0xF9, 0xAD, 0x1F } , // 4
+	{ 0xAA, 0xDA, 0x4C, 0xA8, 0xF6, 0xE5, 0xA9, 0x77, 0xE0, 0xA0, 0xF9, 0xE4, 0x76, 0xCF, 0x0D, 0x63 }   // 5
+};
+
+static const u8 kRsaPublicExponent[Crypto::kRsaPublicExponentSize] = { 0x00, 0x01, 0x00, 0x01 };
+
+bool IsCiaPath(const std::string& path)
+{
+	if (path.size() < 4)
+	{
+		return false;
+	}
+
+	std::string extention = path.substr(path.size() - 4);
+	std::transform(extention.begin(), extention.end(), extention.begin(), ::tolower);
+	return extention == ".cia";
+}
+
+// adds every .cia below a directory, or the path itself when it isn't a directory
+void CollectCiaFiles(const std::string& path, std::vector<std::string>& files)
+{
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+	{
+		files.push_back(path);
+		return;
+	}
+
+	std::vector<std::string> entries;
+	WIN32_FIND_DATAA find_data;
+	HANDLE find = FindFirstFileA((path + "\\*").c_str(), &find_data);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			std::string name(find_data.cFileName);
+			if (name != "." && name != "..")
+			{
+				entries.push_back(path + "\\" + name);
+			}
+		} while (FindNextFileA(find, &find_data));
+		FindClose(find);
+	}
+
+	std::sort(entries.begin(), entries.end());
+	for (const auto& entry : entries)
+	{
+		attributes = GetFileAttributesA(entry.c_str());
+		if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		{
+			CollectCiaFiles(entry, files);
+		}
+		else if (IsCiaPath(entry))
+		{
+			files.push_back(entry);
+		}
+	}
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || S_ISDIR(st.st_mode) == false)
+	{
+		files.push_back(path);
+		return;
+	}
+
+	std::vector<std::string> entries;
+	DIR* dir = opendir(path.c_str());
+	if (dir != nullptr)
+	{
+		for (struct dirent* ent = readdir(dir); ent != nullptr; ent = readdir(dir))
+		{
+			std::string name(ent->d_name);
+			if (name != "." && name != "..")
+			{
+				entries.push_back(path + "/" + name);
+			}
+		}
+		closedir(dir);
+	}
+
+	std::sort(entries.begin(), entries.end());
+	for (const auto& entry : entries)
+	{
+		if (stat(entry.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+		{
+			CollectCiaFiles(entry, files);
+		}
+		else if (IsCiaPath(entry))
+		{
+			files.push_back(entry);
+		}
+	}
+#endif
+}
+
+// one path per line, blank lines and lines starting with '#' are skipped
+void ReadManifest(const std::string& path, std::vector<std::string>& files)
+{
+	std::ifstream manifest(path);
+	if (manifest.is_open() == false)
+	{
+		throw ProjectSnakeException("Failed to open manifest \"" + path + "\"");
+	}
+
+	std::string line;
+	while (std::getline(manifest, line))
+	{
+		if (line.empty() == false && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		CollectCiaFiles(line, files);
+	}
+}
+
+std::string JsonString(const std::string& str)
+{
+	std::string out = "\"";
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)c);
+			out += escape;
+		}
+		else
+		{
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+const char* PassFail(bool is_valid)
+{
+	return is_valid ? "\"pass\"" : "\"fail\"";
+}
+
+// one json object per line, so results can be consumed while the run is in progress
+void PrintResult(const CiaVerifier::sFileResult& result)
+{
+	if (result.error.empty() == false)
+	{
+		printf("{\"path\":%s,\"result\":\"error\",\"error\":%s}\n", JsonString(result.path).c_str(), JsonString(result.error).c_str());
+		fflush(stdout);
+		return;
+	}
+
+	printf("{\"path\":%s,\"result\":%s,\"title_id\":\"%016" PRIx64 "\",\"version\":%u,", JsonString(result.path).c_str(), PassFail(result.is_valid()), result.title_id, result.title_version);
+	printf("\"certs\":%s,\"ca_checked\":%s,\"ticket\":%s,\"tmd\":%s,\"contents\":[", PassFail(result.is_certs_valid), result.is_ca_checked ? "true" : "false", PassFail(result.is_ticket_valid), PassFail(result.is_tmd_valid));
+	for (size_t i = 0; i < result.contents.size(); i++)
+	{
+		const CiaVerifier::sContentResult& content = result.contents[i];
+		printf("%s{\"index\":%u,\"id\":\"%08" PRIx32 "\",\"size\":%" PRIu64 ",\"hash\":%s}", i > 0 ? "," : "", content.content_index, content.content_id, content.size, PassFail(content.is_valid));
+	}
+	printf("],\"bytes\":%" PRIu64 "}\n", result.content_size);
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: %s [-j <threads>] [-r <root modulus file>] [-m <manifest>] <CIA file or directory> ...\n", argv[0]);
+		return 0;
+	}
+
+	std::vector<std::string> files;
+	size_t thread_num = 0;
+	Crypto::sRsa4096Key root_key;
+	bool has_root_key = false;
+
+	try {
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg(argv[i]);
+			if ((arg == "-j" || arg == "-r" || arg == "-m") && i + 1 >= argc)
+			{
+				throw ProjectSnakeException("Option " + arg + " needs a value.");
+			}
+
+			if (arg == "-j")
+			{
+				thread_num = strtoul(argv[++i], nullptr, 0);
+			}
+			else if (arg == "-r")
+			{
+				// the root certificate's public key, as the raw big endian modulus
+				MemoryBlob modulus;
+				FileIO::ReadFile(argv[++i], modulus);
+				if (modulus.size() != Crypto::kRsa4096Size)
+				{
+					throw ProjectSnakeException("Root modulus file must be 0x200 bytes.");
+				}
+				root_key = Crypto::sRsa4096Key();
+				memcpy(root_key.modulus, modulus.data(), Crypto::kRsa4096Size);
+				memcpy(root_key.public_exponent, kRsaPublicExponent, Crypto::kRsaPublicExponentSize);
+				has_root_key = true;
+			}
+			else if (arg == "-m")
+			{
+				ReadManifest(argv[++i], files);
+			}
+			else
+			{
+				CollectCiaFiles(arg, files);
+			}
+		}
+	}
+	catch (const std::exception& except) {
+		printf("[VERIFYCIA ERROR] %s\n", except.what());
+		return 1;
+	}
+
+	WorkStealingPool pool(thread_num > 0 ? thread_num : ThreadPool::default_thread_num());
+	CiaVerifier verifier(pool, es_commonkey_dev, sizeof(es_commonkey_dev) / sizeof(es_commonkey_dev[0]));
+	if (has_root_key)
+	{
+		verifier.SetRootKey(root_key);
+	}
+	verifier.SetResultCallback(PrintResult);
+
+	std::vector<CiaVerifier::sFileResult> results;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	try {
+		verifier.VerifyFiles(files, results);
+	}
+	catch (const ProjectSnakeException& except) {
+		printf("[VERIFYCIA ERROR][%s] %s\n", except.module(), except.what());
+		return 1;
+	}
+	catch (const std::exception& except) {
+		printf("[VERIFYCIA ERROR] %s\n", except.what());
+		return 1;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t pass_num = 0, fail_num = 0, error_num = 0;
+	u64 total_size = 0;
+	for (const auto& result : results)
+	{
+		if (result.error.empty() == false)
+		{
+			error_num++;
+		}
+		else if (result.is_valid())
+		{
+			pass_num++;
+		}
+		else
+		{
+			fail_num++;
+		}
+		total_size += result.content_size;
+	}
+
+	printf("{\"summary\":{\"files\":%zu,\"pass\":%zu,\"fail\":%zu,\"error\":%zu,\"bytes\":%" PRIu64 ",\"seconds\":%.3f,\"mb_per_second\":%.1f,\"threads\":%zu}}\n",
+		results.size(), pass_num, fail_num, error_num, total_size, seconds, seconds > 0 ? total_size / seconds / 1000000.0 : 0.0, pool.thread_num());
+
+	return pass_num == results.size() ? 0 : 1;
+}